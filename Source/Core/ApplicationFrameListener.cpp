@@ -11,6 +11,7 @@
 #include "EngineState.h"
 #include "Planet.h"
 #include "PlanetCube.h"
+#include "PlanetMovable.h"
 
 using namespace Ogre;
 
@@ -377,6 +378,10 @@ void ApplicationFrameListener::updateStats() {
     static String planetHotTiles = "Hot tiles: ";
     static String planetQueue = "Queue size: ";
     static String planetMemory = "GPU tile cache: ";
+    static String planetHeightMemory = "CPU height maps: ";
+    static String planetRetained = "Compressed tiles: ";
+    static String planetPager = "Pager: ";
+    static String planetDropped = "Stale tiles dropped: ";
     
     // update stats when necessary
     try {
@@ -390,7 +395,13 @@ void ApplicationFrameListener::updateStats() {
                             planetActiveRenderables + StringConverter::toString(PlanetStats::renderedRenderables) + "\n" +
                             planetHotTiles + StringConverter::toString(PlanetStats::hotTiles) + "\n" +
                             planetQueue + StringConverter::toString(PlanetStats::requestQueue) + "\n" +
-                            planetMemory + StringConverter::toString(PlanetStats::gpuMemoryUsage >> 20) + " MB" +
+                            planetMemory + StringConverter::toString(PlanetStats::gpuMemoryUsage >> 20) + " MB" + "\n" +
+                            planetHeightMemory + StringConverter::toString(PlanetStats::cpuMemoryUsage >> 20) + " MB" + "\n" +
+                            planetRetained + StringConverter::toString(PlanetStats::retainedTiles) + " (" +
+                            StringConverter::toString(PlanetStats::retainedMemoryUsage >> 20) + " MB)" + "\n" +
+                            planetPager + StringConverter::toString(PlanetStats::pagerTime / 1000.0f, 2) + " ms (" +
+                            StringConverter::toString(PlanetStats::pagerOverruns) + " overruns)" + "\n" +
+                            planetDropped + StringConverter::toString(PlanetStats::droppedTiles) +
                             "");
         
         OverlayElement* guiAvg = OverlayManager::getSingleton().getOverlayElement("Core/AverageFps");
@@ -43,7 +43,40 @@ EngineState::EngineState() {
     setValue("planet.gridSize", 17);    
     setValue("planet.textureSize", 257);    
     
+    // Milliseconds of tile paging work per frame, measured.
     setValue("planet.pagerTimeSlot", 1.f);
+    // Share of the pager time slot kept for split, merge and renderable requests.
+    setValue("planet.pagerInlineShare", 0.25f);
+    // Frames a map tile request may go unwanted by traversal before it's dropped (0 = never).
+    setValue("planet.requestTimeout", 30);
+    // Seconds of LOD camera motion to prefetch tiles ahead for (0 = off).
+    setValue("planet.prefetchHorizon", 0.5f);
+
+    // Map backend: "GPU" (render to texture) or "CPU" (PlanetMapRasterizer).
+    setValue("planet.mapBackend", string("GPU"));
+    // GPU backend: tiles in flight at once, each with its own pair of working buffers.
+    setValue("planet.mapPipeline", 3);
+    // GPU backend: height map readback, "GL" (async pixel buffers) or "CPU" (blocking).
+    setValue("planet.mapReadback", string("GL"));
+    // Megabytes of map tiles and renderables to keep per planet. Least recently used ones are merged or paged out beyond that.
+    setValue("planet.tileCacheMB", 256);
+    // Megabytes of compressed map tiles to keep in memory per planet, for quick restores (0 = off).
+    // Off by default: it encodes every built tile, and on the GPU backend reads back its normals.
+    setValue("planet.tileRetainMB", 0);
+    // Directory to cache finished map tiles in, per planet ("" = off).
+    setValue("planet.tileCache", string(""));
+    // Loose cached tiles to collect before they're folded into the pack on exit, which rewrites it.
+    setValue("planet.tilePackThreshold", 512);
+    // CPU backend worker threads (0 = one per core).
+    setValue("planet.mapThreads", 0);
+    // CPU backend: seed child tiles from their parent's heights, adding only finer brushes.
+    setValue("planet.mapUpsample", false);
+    // CPU backend: bake brushes at least this large (half-extent) into a per-face base map
+    // of this size (2^n + 1, 0 = off).
+    setValue("planet.baseMapSize", 0);
+    setValue("planet.baseMapThreshold", 0.25f);
+    // CPU backend: terrain script (see PlanetTerrainScript), empty = brushes only.
+    setValue("planet.script", string(""));
 
     //setValue("planet.seed", 1007);    
     setValue("planet.seed",  1137);
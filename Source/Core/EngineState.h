@@ -11,11 +11,8 @@
 #define EngineState_H
 
 #include <Ogre/Ogre.h>
-#include <OIS/OIS.h>
 
 #include <map>
-#include "PlanetMovable.h"
-#include "ApplicationFrameListener.h"
 
 namespace NFSpace {
 
@@ -14,6 +14,13 @@
 
 #include "Utility.h"
 
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#else
+#include <unistd.h>
+#endif
+
 namespace NFSpace {
     
 /**
@@ -112,4 +119,22 @@ Ogre::Image cropImage(const Ogre::Image& source, size_t offsetX, size_t offsetY,
             Ogre::Pass::processPendingPassUpdates();
         }
     }
+
+    int getProcessorCount() {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return maxi(1, info.dwNumberOfProcessors);
+#else
+        return maxi(1, sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    }
+
+    bool replaceFile(const String& from, const String& to) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
 };
\ No newline at end of file
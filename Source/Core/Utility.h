@@ -19,6 +19,9 @@ namespace NFSpace {
     Ogre::Image cropImage(const Ogre::Image& source, size_t offsetX, size_t offsetY, size_t width, size_t height);
     void saveTexture(Ogre::TexturePtr texture);
     void updateSceneManagersAfterMaterialsChange();
+    int getProcessorCount();
+    // rename(), replacing an existing target on Win32 too.
+    bool replaceFile(const String& from, const String& to);
 
     inline int maxi(int a, int b) {
         return a > b ? a : b;
@@ -40,6 +43,28 @@ namespace NFSpace {
         return float(rand()) / RAND_MAX;
     }
 
+    /**
+     * Stateless random numbers: a hash of (seed, index, field) instead of a running sequence,
+     * so any value can be regenerated on its own, in any order, from any thread.
+     */
+    inline uint32 hashi(uint32 x) {
+        x ^= x >> 16;
+        x *= 0x7feb352d;
+        x ^= x >> 15;
+        x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    inline uint32 randi(uint32 seed, uint32 index, uint32 field) {
+        return hashi(hashi(hashi(seed + 0x9e3779b9) ^ index) + field);
+    }
+
+    inline float randf(uint32 seed, uint32 index, uint32 field) {
+        // Top 24 bits, mapped to [0, 1).
+        return (randi(seed, index, field) >> 8) * (1.0f / 16777216.0f);
+    }
+
     inline bool isPowerOf2(int x) {
         return !(x & (x - 1));
     }
@@ -0,0 +1,163 @@
+/*
+ *  PlanetBaseMap.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetBaseMap.h"
+
+#include "Utility.h"
+
+namespace NFSpace {
+
+const int PlanetBaseMap::MIN_LEVEL_SIZE = 33;
+
+PlanetBaseMap::PlanetBaseMap(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, int size, PlanetMapWorkers* workers) {
+    assert(isPowerOf2(size - 1));
+
+    // Allocate pyramid levels, finest first.
+    for (; size >= MIN_LEVEL_SIZE || mLevels.empty(); size = (size - 1) / 2 + 1) {
+        Level level;
+        level.mSize = size;
+        // Only the finest level loads the brush and noise maps, coarser ones share them.
+        if (mLevels.empty()) {
+            level.mRasterizer = new PlanetMapRasterizer(size, 1, 0.0f);
+        }
+        else {
+            level.mRasterizer = new PlanetMapRasterizer(*mLevels.front().mRasterizer, size, 1, 0.0f);
+        }
+        level.mFullSize = level.mRasterizer->getFullSize();
+        for (int face = 0; face < 6; ++face) {
+            level.mHeights[face] = OGRE_ALLOC_T(float, level.mFullSize * level.mFullSize, MEMCATEGORY_GENERAL);
+        }
+        mLevels.push_back(level);
+    }
+
+    // Bake every face of every level, in parallel if possible.
+    for (std::vector<Level>::iterator it = mLevels.begin(); it != mLevels.end(); ++it) {
+        for (int face = 0; face < 6; ++face) {
+            BakeJob* job = new BakeJob(table, brushes, *it, face);
+            if (workers) {
+                workers->submit(job);
+            }
+            else {
+                job->run();
+                delete job;
+            }
+        }
+    }
+    if (workers) {
+        workers->finish();
+
+        PlanetMapWorkers::JobList finished;
+        workers->collect(finished);
+        for (PlanetMapWorkers::JobList::iterator it = finished.begin(); it != finished.end(); ++it) {
+            delete *it;
+        }
+    }
+}
+
+PlanetBaseMap::~PlanetBaseMap() {
+    // Coarsest first, the finest level owns the shared maps.
+    for (std::vector<Level>::reverse_iterator it = mLevels.rbegin(); it != mLevels.rend(); ++it) {
+        for (int face = 0; face < 6; ++face) {
+            OGRE_FREE(it->mHeights[face], MEMCATEGORY_GENERAL);
+        }
+        delete it->mRasterizer;
+    }
+}
+
+/**
+ * Split brushes into those that go in the base map (largest half-extent at or above the
+ * threshold) and those that stay live.
+ */
+void PlanetBaseMap::splitBrushes(const PlanetBrushTable& table, Real threshold, PlanetBrushTable::BrushSet& baked, PlanetBrushTable::BrushSet& live) {
+    baked.clear();
+    live.clear();
+    for (int i = 0; i < table.size(); ++i) {
+        const Vector2& scale = table.mScale[i];
+        if (maxf(scale.x, scale.y) >= threshold) {
+            baked.push_back(i);
+        }
+        else {
+            live.push_back(i);
+        }
+    }
+}
+
+/**
+ * Finest level that is no denser than the tile, to avoid aliasing. Tiles finer than the
+ * base map magnify its top level.
+ */
+const PlanetBaseMap::Level& PlanetBaseMap::getLevel(int lod, int tileSize) const {
+    Real tileDensity = Real(1 << lod) * (tileSize - 1);
+    for (std::vector<Level>::const_iterator it = mLevels.begin(); it != mLevels.end(); ++it) {
+        if (it->mSize - 1 <= tileDensity) {
+            return *it;
+        }
+    }
+    return mLevels.back();
+}
+
+/**
+ * Fill tile workspace rows [begin, end) with fill + base heights, bilinearly interpolated.
+ */
+void PlanetBaseMap::sampleRows(const PlanetMapRasterizer& tile, int face, int lod, int x, int y, Real fill, float* heights, int begin, int end) const {
+    sampleRect(tile, face, lod, x, y, fill, heights, 0, begin, tile.getFullSize(), end);
+}
+
+/**
+ * Same as sampleRows, for the texels in columns [left, right) of rows [top, bottom).
+ */
+void PlanetBaseMap::sampleRect(const PlanetMapRasterizer& tile, int face, int lod, int x, int y, Real fill, float* heights, int left, int top, int right, int bottom) const {
+    int tileFullSize = tile.getFullSize();
+    const Level& level = getLevel(lod, tileFullSize - 2);
+    const float* source = level.mHeights[face];
+
+    // Texel positions map linearly between tile and base map, via face space.
+    Real faceX0, faceY0, faceX1, faceY1, faceX, faceY;
+    level.mRasterizer->getTexelFace(0, 0, 0, 0, 0, faceX0, faceY0);
+    level.mRasterizer->getTexelFace(0, 0, 0, 1, 1, faceX1, faceY1);
+
+    std::vector<int> columns(tileFullSize);
+    std::vector<Real> columnWeights(tileFullSize);
+    for (int column = left; column < right; ++column) {
+        tile.getTexelFace(lod, x, y, column, 0, faceX, faceY);
+        Real coordinate = (faceX - faceX0) / (faceX1 - faceX0);
+        coordinate = maxf(0, minf(level.mFullSize - 1, coordinate));
+        columns[column] = mini((int)coordinate, level.mFullSize - 2);
+        columnWeights[column] = coordinate - columns[column];
+    }
+
+    for (int row = top; row < bottom; ++row) {
+        tile.getTexelFace(lod, x, y, 0, row, faceX, faceY);
+        Real coordinate = (faceY - faceY0) / (faceY1 - faceY0);
+        coordinate = maxf(0, minf(level.mFullSize - 1, coordinate));
+        int index = mini((int)coordinate, level.mFullSize - 2);
+        Real rowWeight = coordinate - index;
+
+        const float* pTop = source + index * level.mFullSize;
+        const float* pBottom = pTop + level.mFullSize;
+        float* pOut = heights + row * tileFullSize + left;
+        for (int column = left; column < right; ++column) {
+            int sourceColumn = columns[column];
+            Real weight = columnWeights[column];
+
+            Real upper = pTop[sourceColumn] + (pTop[sourceColumn + 1] - pTop[sourceColumn]) * weight;
+            Real lower = pBottom[sourceColumn] + (pBottom[sourceColumn + 1] - pBottom[sourceColumn]) * weight;
+            *pOut++ = fill + upper + (lower - upper) * rowWeight;
+        }
+    }
+}
+
+PlanetBaseMap::BakeJob::BakeJob(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, const Level& level, int face)
+: mTable(table), mBrushes(brushes), mLevel(level), mFace(face) {
+}
+
+void PlanetBaseMap::BakeJob::run() {
+    mLevel.mRasterizer->render(mFace, 0, 0, 0, mTable, mBrushes, mLevel.mHeights[mFace]);
+}
+
+};
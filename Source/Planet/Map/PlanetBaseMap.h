@@ -0,0 +1,71 @@
+/*
+ *  PlanetBaseMap.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetBaseMap_H
+#define PlanetBaseMap_H
+
+#include <Ogre/Ogre.h>
+#include <vector>
+
+#include "PlanetBrushTable.h"
+#include "PlanetMapRasterizer.h"
+#include "PlanetMapWorkers.h"
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Low-frequency height map of the large brushes on a planet, baked once per cube face.
+     *
+     * Each face is stored as a pyramid of workspaces, every level rasterized directly at
+     * half the resolution of the one above it. Tiles sample the level that matches their
+     * own texel density, and only rasterize the remaining small brushes themselves.
+     */
+    class PlanetBaseMap {
+    public:
+        static const int MIN_LEVEL_SIZE;
+
+        PlanetBaseMap(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, int size, PlanetMapWorkers* workers);
+        ~PlanetBaseMap();
+
+        void sampleRows(const PlanetMapRasterizer& tile, int face, int lod, int x, int y, Real fill, float* heights, int begin, int end) const;
+        void sampleRect(const PlanetMapRasterizer& tile, int face, int lod, int x, int y, Real fill, float* heights, int left, int top, int right, int bottom) const;
+
+        static void splitBrushes(const PlanetBrushTable& table, Real threshold, PlanetBrushTable::BrushSet& baked, PlanetBrushTable::BrushSet& live);
+
+    protected:
+        struct Level {
+            int mSize;
+            int mFullSize;
+            PlanetMapRasterizer* mRasterizer;
+            float* mHeights[6];
+        };
+
+        /**
+         * Bakes one face of one level, run on a worker thread.
+         */
+        class BakeJob : public PlanetMapWorkers::Job {
+        public:
+            BakeJob(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, const Level& level, int face);
+            virtual void run();
+
+            const PlanetBrushTable& mTable;
+            const PlanetBrushTable::BrushSet& mBrushes;
+            const Level& mLevel;
+            int mFace;
+        };
+
+        const Level& getLevel(int lod, int tileSize) const;
+
+        std::vector<Level> mLevels;
+    };
+
+};
+
+#endif
@@ -13,87 +13,90 @@
 
 namespace NFSpace {
 
-int PlanetBrush::sInstances = 0;
-VertexData* PlanetBrush::sVertexData;
-
-PlanetBrush::PlanetBrush() : SimpleRenderable() {
-    addInstance();
+PlanetBrush::PlanetBrush() : SimpleRenderable(), mCapacity(0) {
     initRenderOp();
 }
 
 PlanetBrush::~PlanetBrush() {
-    removeInstance();
+    delete mRenderOp.vertexData;
 }
 
-void PlanetBrush::initRenderOp() {    
-    mRenderOp.operationType = RenderOperation::OT_TRIANGLE_STRIP;
+void PlanetBrush::initRenderOp() {
+    mRenderOp.operationType = RenderOperation::OT_TRIANGLE_LIST;
     mRenderOp.useIndexes = FALSE;
-    mRenderOp.vertexData = sVertexData;    
-
-    setBoundingBox(AxisAlignedBox(Vector3(-getBoundingRadius()), Vector3(getBoundingRadius())));
-
-    setMaterial("Planet/BrushCarverNoisy");
+    mRenderOp.vertexData = new VertexData();
+    mRenderOp.vertexData->vertexCount = 0;
 
     /*
-     param_named_auto carveIntensity custom 1
-     param_named_auto noiseIntensity custom 2
-     param_named_auto noiseScale custom 3
-     param_named_auto noiseOffset custom 4
+     TEXCOORD0: brush uv
+     TEXCOORD1: carveIntensity, noiseIntensity, noiseScale
+     TEXCOORD2: noiseOffset
         */
-	setCustomParameter(1, Vector4((randf() * .5 - .25), 0, 0, 0));
-	setCustomParameter(2, Vector4(0.05, 0, 0, 0));
-    setCustomParameter(3, Vector4(0.25, 0, 0, 0));
-	setCustomParameter(4, Vector4(randf() * 2.0 - 1.0, randf() * 2.0 - 1.0, 0, 0));
+    VertexDeclaration *vertexDeclaration = mRenderOp.vertexData->vertexDeclaration;
+    size_t offset = 0;
+    vertexDeclaration->addElement(0, offset, VET_FLOAT3, VES_POSITION);
+    offset += VertexElement::getTypeSize(VET_FLOAT3);
+    vertexDeclaration->addElement(0, offset, VET_FLOAT2, VES_TEXTURE_COORDINATES, 0);
+    offset += VertexElement::getTypeSize(VET_FLOAT2);
+    vertexDeclaration->addElement(0, offset, VET_FLOAT3, VES_TEXTURE_COORDINATES, 1);
+    offset += VertexElement::getTypeSize(VET_FLOAT3);
+    vertexDeclaration->addElement(0, offset, VET_FLOAT2, VES_TEXTURE_COORDINATES, 2);
+
+    setBoundingBox(AxisAlignedBox(Vector3(-getBoundingRadius()), Vector3(getBoundingRadius())));
+
+    setMaterial("Planet/BrushCarverBatched");
 }
 
-void PlanetBrush::addInstance() {
-    if (!sInstances++) {
-        sVertexData = new VertexData();
-
-        VertexDeclaration *vertexDeclaration = sVertexData->vertexDeclaration;
-        size_t offset = 0;
-        vertexDeclaration->addElement(0, offset, VET_FLOAT3, VES_POSITION);
-        offset += VertexElement::getTypeSize(VET_FLOAT3);
-        vertexDeclaration->addElement(0, offset, VET_FLOAT2, VES_TEXTURE_COORDINATES, 0);
-        offset += VertexElement::getTypeSize(VET_FLOAT2);
-        
-        HardwareVertexBufferSharedPtr vertexBuffer = HardwareBufferManager::getSingleton()
-            .createVertexBuffer(offset, 4, HardwareBuffer::HBU_STATIC_WRITE_ONLY);
-
-        sVertexData->vertexBufferBinding->setBinding(0, vertexBuffer);
-
-        const VertexElement* poselem = vertexDeclaration->findElementBySemantic(VES_POSITION);
-        const VertexElement* texelem = vertexDeclaration->findElementBySemantic(VES_TEXTURE_COORDINATES, 0);
-
-        unsigned char* pBase = static_cast<unsigned char*>(vertexBuffer->lock(HardwareBuffer::HBL_DISCARD));
-
-        for (int y = 0; y < 2; ++y) {
-            for (int x = 0; x < 2; ++x) {
-                float* pPos;
-                float* pTex;
-                poselem->baseVertexPointerToElement(pBase, &pPos);
-                texelem->baseVertexPointerToElement(pBase, &pTex);
-              
-                *pPos++ = x * 2 - 1;
-                *pPos++ = y * 2 - 1;
-                *pPos++ = 0;
-                *pTex++ = x;
-                *pTex++ = y;
-
-                pBase += vertexBuffer->getVertexSize();
-            }
-        }
-        
-        sVertexData->vertexCount = 4;
+void PlanetBrush::resizeBuffer(size_t brushes) {
+    if (brushes <= mCapacity) return;
 
-        vertexBuffer->unlock();
-    }
+    // Grow geometrically to avoid reallocating for every slightly bigger tile.
+    mCapacity = std::max(brushes, mCapacity * 2);
+
+    mVertexBuffer = HardwareBufferManager::getSingleton()
+        .createVertexBuffer(mRenderOp.vertexData->vertexDeclaration->getVertexSize(0), mCapacity * 6,
+                            HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+    mRenderOp.vertexData->vertexBufferBinding->setBinding(0, mVertexBuffer);
 }
 
-void PlanetBrush::removeInstance() {
-    if (!--sInstances) {
-        delete sVertexData;
+/**
+ * Pack the given brushes from the table into the batch, as two triangles each.
+ */
+void PlanetBrush::update(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes) {
+    mRenderOp.vertexData->vertexCount = brushes.size() * 6;
+    if (brushes.empty()) return;
+
+    resizeBuffer(brushes.size());
+
+    // Quad corners in triangle list order.
+    static const int corners[6][2] = {
+        { 0, 0 }, { 1, 0 }, { 0, 1 },
+        { 0, 1 }, { 1, 0 }, { 1, 1 },
+    };
+
+    float* pVertex = static_cast<float*>(mVertexBuffer->lock(HardwareBuffer::HBL_DISCARD));
+    for (PlanetBrushTable::BrushSet::const_iterator it = brushes.begin(); it != brushes.end(); ++it) {
+        int brush = *it;
+        Vector3 right = table.mRight[brush] * table.mScale[brush].x;
+        Vector3 front = table.mFront[brush] * table.mScale[brush].y;
+
+        for (int i = 0; i < 6; ++i) {
+            int x = corners[i][0], y = corners[i][1];
+            Vector3 position = table.mPosition[brush] + right * (x * 2 - 1) + front * (y * 2 - 1);
+
+            *pVertex++ = position.x;
+            *pVertex++ = position.y;
+            *pVertex++ = position.z;
+            *pVertex++ = x;
+            *pVertex++ = y;
+            *pVertex++ = table.mCarveIntensity[brush];
+            *pVertex++ = table.mNoiseIntensity[brush];
+            *pVertex++ = table.mNoiseScale[brush];
+            *pVertex++ = table.mNoiseOffset[brush].x;
+            *pVertex++ = table.mNoiseOffset[brush].y;
+        }
     }
+    mVertexBuffer->unlock();
 }
 
 const String& PlanetBrush::getMovableType(void) const {
@@ -109,4 +112,4 @@ Real PlanetBrush::getSquaredViewDepth(const Camera* cam) const {
     return 1;
 }
 
-};
\ No newline at end of file
+};
@@ -13,22 +13,30 @@
 #include <Ogre/Ogre.h>
 #include <Ogre/OgreSimpleRenderable.h>
 
+#include "PlanetBrushTable.h"
+
 using namespace Ogre;
 
 namespace NFSpace {
 
+/**
+ * Batch of brush quads, drawn in a single call.
+ *
+ * Quads are expanded to world space on the CPU. Per-brush shader parameters travel
+ * in texture coordinates 1 and 2, see brushCarverBatched_FP.
+ */
 class PlanetBrush : public SimpleRenderable {
-    static int sInstances;
-    static VertexData* sVertexData;
-    
-    static void addInstance();
-    static void removeInstance();
-    
+    HardwareVertexBufferSharedPtr mVertexBuffer;
+    size_t mCapacity;
+
     void initRenderOp();
+    void resizeBuffer(size_t brushes);
 public:
     PlanetBrush();
     ~PlanetBrush();
 
+    void update(const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes);
+
     virtual Real getBoundingRadius() const;
     virtual Real getSquaredViewDepth(const Camera* cam) const;
     virtual const String& getMovableType(void) const;
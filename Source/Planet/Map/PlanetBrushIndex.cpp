@@ -0,0 +1,192 @@
+/*
+ *  PlanetBrushIndex.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetBrushIndex.h"
+#include "PlanetCube.h"
+
+#include "Utility.h"
+
+#include <algorithm>
+
+namespace NFSpace {
+
+const int PlanetBrushIndex::MAX_DEPTH = 12;
+
+PlanetBrushIndex::Cell::Cell() {
+    for (int i = 0; i < 4; ++i) {
+        mChildren[i] = 0;
+    }
+}
+
+PlanetBrushIndex::Cell::~Cell() {
+    for (int i = 0; i < 4; ++i) {
+        delete mChildren[i];
+    }
+}
+
+PlanetBrushIndex::PlanetBrushIndex(const PlanetBrushTable& table, int size, int border) {
+    init(size, border);
+    for (int i = 0; i < table.size(); ++i) {
+        add(table, i);
+    }
+}
+
+/**
+ * Index only a subset of the table, e.g. the brushes not baked into a base map.
+ */
+PlanetBrushIndex::PlanetBrushIndex(const PlanetBrushTable& table, const BrushSet& brushes, int size, int border) {
+    init(size, border);
+    for (BrushSet::const_iterator it = brushes.begin(); it != brushes.end(); ++it) {
+        add(table, *it);
+    }
+}
+
+PlanetBrushIndex::~PlanetBrushIndex() {
+    for (int face = 0; face < 6; ++face) {
+        delete mRoots[face];
+    }
+}
+
+void PlanetBrushIndex::init(int size, int border) {
+    // A tile's border reaches (2 * border + 1) / (2 * size) tile widths past its edge
+    // (see border dilation in PlanetMapBuffer::renderTile). Round up a little.
+    mPadding = (2.0f * border + 1.0f) / (2.0f * size) * 1.01f;
+
+    for (int face = 0; face < 6; ++face) {
+        mRoots[face] = new Cell();
+    }
+}
+
+void PlanetBrushIndex::add(const PlanetBrushTable& table, int brush) {
+    Entry entry;
+    for (int face = 0; face < 6; ++face) {
+        if (getFootprint(table, brush, face, entry)) {
+            entry.mBrush = brush;
+            insert(face, entry);
+        }
+    }
+}
+
+/**
+ * Bounding rectangle of a brush quad as seen through a face camera.
+ */
+bool PlanetBrushIndex::getFootprint(const PlanetBrushTable& table, int brush, int face, Entry& entry) const {
+    Quaternion orientation = PlanetCube::getFaceCamera(face);
+    orientation.normalise();
+    Quaternion inverse = orientation.Inverse();
+
+    // Brush quad corners in face camera space.
+    Vector3 corners[4];
+    const Vector3& position = table.mPosition[brush];
+    Vector3 right = table.mRight[brush] * table.mScale[brush].x, front = table.mFront[brush] * table.mScale[brush].y;
+    corners[0] = inverse * (position - right - front);
+    corners[1] = inverse * (position + right - front);
+    corners[2] = inverse * (position + right + front);
+    corners[3] = inverse * (position - right + front);
+
+    // Clip against a near plane in front of the camera (looking down -Z).
+    // Points close to the plane project far out, which keeps the rectangle conservative.
+    const Real nearDepth = 1e-3f;
+    Vector3 clipped[8];
+    int count = 0;
+    for (int i = 0; i < 4; ++i) {
+        const Vector3& a = corners[i];
+        const Vector3& b = corners[(i + 1) & 3];
+        bool aIn = -a.z >= nearDepth, bIn = -b.z >= nearDepth;
+        if (aIn) {
+            clipped[count++] = a;
+        }
+        if (aIn != bIn) {
+            Real t = (-nearDepth - a.z) / (b.z - a.z);
+            clipped[count++] = a + (b - a) * t;
+        }
+    }
+    if (!count) return false;
+
+    entry.mLeft = entry.mTop = Math::POS_INFINITY;
+    entry.mRight = entry.mBottom = Math::NEG_INFINITY;
+    for (int i = 0; i < count; ++i) {
+        // 90 degree FOV projection, mapped to face coordinates.
+        Real depth = -clipped[i].z;
+        Real u = (clipped[i].x / depth + 1.0f) * 0.5f;
+        Real v = (1.0f - clipped[i].y / depth) * 0.5f;
+        entry.mLeft = minf(entry.mLeft, u);
+        entry.mRight = maxf(entry.mRight, u);
+        entry.mTop = minf(entry.mTop, v);
+        entry.mBottom = maxf(entry.mBottom, v);
+    }
+
+    // Reject if not even the root tile's border can see it.
+    return entry.mRight >= -mPadding && entry.mLeft <= 1.0f + mPadding &&
+           entry.mBottom >= -mPadding && entry.mTop <= 1.0f + mPadding;
+}
+
+void PlanetBrushIndex::insert(int face, const Entry& entry) {
+    // Place the entry by its on-face extent. Anything hanging over the edge is only seen
+    // by the borders of edge tiles, which always overlap the cells along that edge.
+    Real left = maxf(0.0f, minf(1.0f, entry.mLeft));
+    Real right = maxf(0.0f, minf(1.0f, entry.mRight));
+    Real top = maxf(0.0f, minf(1.0f, entry.mTop));
+    Real bottom = maxf(0.0f, minf(1.0f, entry.mBottom));
+
+    Cell* cell = mRoots[face];
+    for (int level = 1; level <= MAX_DEPTH; ++level) {
+        int scale = 1 << level;
+        int x0 = mini((int)(left * scale), scale - 1), x1 = mini((int)(right * scale), scale - 1);
+        int y0 = mini((int)(top * scale), scale - 1), y1 = mini((int)(bottom * scale), scale - 1);
+        if (x0 != x1 || y0 != y1) break;
+
+        int child = (x0 & 1) + (y0 & 1) * 2;
+        if (!cell->mChildren[child]) {
+            cell->mChildren[child] = new Cell();
+        }
+        cell = cell->mChildren[child];
+    }
+    cell->mEntries.push_back(entry);
+}
+
+/**
+ * Collect all brushes that affect the given tile, in their original order.
+ */
+void PlanetBrushIndex::query(int face, int lod, int x, int y, BrushSet& brushes) const {
+    brushes.clear();
+
+    Real scale = 1 << lod;
+    Entry rect;
+    rect.mLeft = (x - mPadding) / scale;
+    rect.mRight = (x + 1 + mPadding) / scale;
+    rect.mTop = (y - mPadding) / scale;
+    rect.mBottom = (y + 1 + mPadding) / scale;
+
+    queryCell(mRoots[face], 0, 0, 0, rect, brushes);
+    std::sort(brushes.begin(), brushes.end());
+}
+
+void PlanetBrushIndex::queryCell(const Cell* cell, int level, int x, int y, const Entry& rect, BrushSet& brushes) const {
+    for (std::vector<Entry>::const_iterator it = cell->mEntries.begin(); it != cell->mEntries.end(); ++it) {
+        if (it->mRight >= rect.mLeft && it->mLeft <= rect.mRight &&
+            it->mBottom >= rect.mTop && it->mTop <= rect.mBottom) {
+            brushes.push_back(it->mBrush);
+        }
+    }
+
+    // Recurse into children that overlap the query.
+    Real childSize = 1.0f / (1 << (level + 1));
+    for (int i = 0; i < 4; ++i) {
+        const Cell* child = cell->mChildren[i];
+        if (!child) continue;
+
+        int childX = x * 2 + (i & 1), childY = y * 2 + (i >> 1);
+        if ((childX + 1) * childSize >= rect.mLeft && childX * childSize <= rect.mRight &&
+            (childY + 1) * childSize >= rect.mTop && childY * childSize <= rect.mBottom) {
+            queryCell(child, level + 1, childX, childY, rect, brushes);
+        }
+    }
+}
+
+};
@@ -0,0 +1,72 @@
+/*
+ *  PlanetBrushIndex.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetBrushIndex_H
+#define PlanetBrushIndex_H
+
+#include <Ogre/Ogre.h>
+#include <vector>
+
+#include "PlanetBrushTable.h"
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Spatial index of brush footprints on the cube faces.
+     *
+     * Every brush quad is projected onto each cube face it is visible from, and its bounding
+     * rectangle is stored in the smallest quadtree cell of that face that fully contains it.
+     * Looking up a tile then only walks the cells along its path in the tree (and the ones
+     * overlapped by its border), instead of every brush on the planet.
+     *
+     * Face coordinates are normalized to [0, 1] with v running top-down, like tile (x, y).
+     */
+    class PlanetBrushIndex {
+    public:
+        static const int MAX_DEPTH;
+
+        typedef PlanetBrushTable::BrushSet BrushSet;
+
+        PlanetBrushIndex(const PlanetBrushTable& table, int size, int border);
+        PlanetBrushIndex(const PlanetBrushTable& table, const BrushSet& brushes, int size, int border);
+        ~PlanetBrushIndex();
+
+        void query(int face, int lod, int x, int y, BrushSet& brushes) const;
+
+    protected:
+        struct Entry {
+            int mBrush;
+            Real mLeft;
+            Real mTop;
+            Real mRight;
+            Real mBottom;
+        };
+
+        struct Cell {
+            Cell();
+            ~Cell();
+
+            std::vector<Entry> mEntries;
+            Cell* mChildren[4];
+        };
+
+        void init(int size, int border);
+        void add(const PlanetBrushTable& table, int brush);
+        bool getFootprint(const PlanetBrushTable& table, int brush, int face, Entry& entry) const;
+        void insert(int face, const Entry& entry);
+        void queryCell(const Cell* cell, int level, int x, int y, const Entry& rect, BrushSet& brushes) const;
+
+        Cell* mRoots[6];
+        Real mPadding;
+    };
+
+};
+
+#endif
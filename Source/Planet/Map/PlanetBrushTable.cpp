@@ -0,0 +1,95 @@
+/*
+ *  PlanetBrushTable.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetBrushTable.h"
+
+#include "Utility.h"
+
+namespace NFSpace {
+
+PlanetBrushTable::PlanetBrushTable() {
+}
+
+PlanetBrushTable::~PlanetBrushTable() {
+}
+
+int PlanetBrushTable::add(const Vector3& position, const Vector3& right, const Vector3& front, const Vector2& scale,
+                          Real carveIntensity, Real noiseIntensity, Real noiseScale, const Vector2& noiseOffset) {
+    mPosition.push_back(position);
+    mRight.push_back(right);
+    mFront.push_back(front);
+    mScale.push_back(scale);
+    mCarveIntensity.push_back(carveIntensity);
+    mNoiseIntensity.push_back(noiseIntensity);
+    mNoiseScale.push_back(noiseScale);
+    mNoiseOffset.push_back(noiseOffset);
+    return size() - 1;
+}
+
+/**
+ * Add a brush centered on a point of the unit sphere, turned to face along up.
+ */
+int PlanetBrushTable::place(const Vector3& position, const Vector2& scale, const Vector3& up, Real carveIntensity, const Vector2& noiseOffset) {
+    Vector3 right = position.crossProduct(up);
+    Vector3 front = position.crossProduct(right);
+    right.normalise(); front.normalise();
+
+    return add(position, right, front, scale, carveIntensity, 0.05, 0.25, noiseOffset);
+}
+
+/**
+ * Add a planet's random brushes. Brush parameters only depend on the seed and brush index.
+ */
+void PlanetBrushTable::generate(int seed, int count) {
+    reserve(size() + count);
+    for (int index = 0; index < count; ++index) {
+        Vector3 position = Vector3(randf(seed, index, BRUSH_POSITION_X) * 2 - 1,
+                                   randf(seed, index, BRUSH_POSITION_Y) * 2 - 1,
+                                   randf(seed, index, BRUSH_POSITION_Z) * 2 - 1);
+        position.normalise();
+        Vector3 up = Vector3(randf(seed, index, BRUSH_UP_X) * 2 - 1,
+                             randf(seed, index, BRUSH_UP_Y) * 2 - 1,
+                             randf(seed, index, BRUSH_UP_Z) * 2 - 1);
+        float scale = randf(seed, index, BRUSH_SCALE) * .95 + .05;
+        float aspect = randf(seed, index, BRUSH_ASPECT) + .5;
+
+        Real carveIntensity = randf(seed, index, BRUSH_CARVE_INTENSITY) * .5 - .25;
+        Vector2 noiseOffset = Vector2(randf(seed, index, BRUSH_NOISE_OFFSET_X) * 2.0 - 1.0,
+                                      randf(seed, index, BRUSH_NOISE_OFFSET_Y) * 2.0 - 1.0);
+
+        place(position, Vector2(scale, scale * aspect), up, carveIntensity, noiseOffset);
+    }
+}
+
+void PlanetBrushTable::reserve(int count) {
+    mPosition.reserve(count);
+    mRight.reserve(count);
+    mFront.reserve(count);
+    mScale.reserve(count);
+    mCarveIntensity.reserve(count);
+    mNoiseIntensity.reserve(count);
+    mNoiseScale.reserve(count);
+    mNoiseOffset.reserve(count);
+}
+
+void PlanetBrushTable::clear() {
+    mPosition.clear();
+    mRight.clear();
+    mFront.clear();
+    mScale.clear();
+    mCarveIntensity.clear();
+    mNoiseIntensity.clear();
+    mNoiseScale.clear();
+    mNoiseOffset.clear();
+}
+
+int PlanetBrushTable::size() const {
+    return (int)mPosition.size();
+}
+
+};
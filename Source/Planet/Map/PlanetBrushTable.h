@@ -0,0 +1,75 @@
+/*
+ *  PlanetBrushTable.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetBrushTable_H
+#define PlanetBrushTable_H
+
+#include <Ogre/Ogre.h>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Flat table of all brushes that make up a planet's height map.
+     *
+     * Stored as parallel arrays, one field per array, indexed by brush number. Both map
+     * backends read brushes straight from here: the CPU rasterizer per texel, the GPU
+     * path by packing the brushes of a tile into a single PlanetBrush batch.
+     */
+    class PlanetBrushTable {
+    public:
+        typedef std::vector<int> BrushSet;
+
+        PlanetBrushTable();
+        ~PlanetBrushTable();
+
+        int add(const Vector3& position, const Vector3& right, const Vector3& front, const Vector2& scale,
+                Real carveIntensity, Real noiseIntensity, Real noiseScale, const Vector2& noiseOffset);
+        int place(const Vector3& position, const Vector2& scale, const Vector3& up, Real carveIntensity, const Vector2& noiseOffset);
+        void generate(int seed, int count);
+        void reserve(int count);
+        void clear();
+        int size() const;
+
+        // Center on the unit sphere, and the tangent basis of the brush quad.
+        std::vector<Vector3> mPosition;
+        std::vector<Vector3> mRight;
+        std::vector<Vector3> mFront;
+        // Half-extents of the quad along right and front.
+        std::vector<Vector2> mScale;
+
+        // brushCarverNoisy_FP parameters.
+        std::vector<Real> mCarveIntensity;
+        std::vector<Real> mNoiseIntensity;
+        std::vector<Real> mNoiseScale;
+        std::vector<Vector2> mNoiseOffset;
+
+    protected:
+        /**
+         * Random streams used for generating a brush, see randf(seed, index, field).
+         */
+        enum {
+            BRUSH_POSITION_X,
+            BRUSH_POSITION_Y,
+            BRUSH_POSITION_Z,
+            BRUSH_UP_X,
+            BRUSH_UP_Y,
+            BRUSH_UP_Z,
+            BRUSH_SCALE,
+            BRUSH_ASPECT,
+            BRUSH_CARVE_INTENSITY,
+            BRUSH_NOISE_OFFSET_X,
+            BRUSH_NOISE_OFFSET_Y,
+        };
+    };
+
+};
+
+#endif
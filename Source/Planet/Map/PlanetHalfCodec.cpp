@@ -0,0 +1,209 @@
+/*
+ *  PlanetHalfCodec.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetHalfCodec.h"
+
+#include <algorithm>
+
+namespace NFSpace {
+
+namespace {
+    // Half bit pattern <-> integer in float order.
+    inline unsigned short toOrdered(unsigned short half) {
+        return (half & 0x8000) ? (unsigned short)~half : (unsigned short)(half | 0x8000);
+    }
+
+    inline unsigned short fromOrdered(unsigned short value) {
+        return (value & 0x8000) ? (unsigned short)(value & 0x7FFF) : (unsigned short)~value;
+    }
+
+    inline unsigned short zigzag(unsigned short residual) {
+        return (unsigned short)((residual << 1) ^ (unsigned short)((short)residual >> 15));
+    }
+
+    inline unsigned short unzigzag(unsigned short code) {
+        return (unsigned short)((code >> 1) ^ (unsigned short)-(short)(code & 1));
+    }
+
+    // LOCO-I median edge detector: picks the left or upper neighbour across an edge, the
+    // planar estimate otherwise.
+    inline unsigned short predictMED(int left, int up, int upLeft) {
+        int low = std::min(left, up), high = std::max(left, up);
+        if (upLeft >= high) return (unsigned short)low;
+        if (upLeft <= low) return (unsigned short)high;
+        return (unsigned short)(left + up - upLeft);
+    }
+
+    // First row from the left, first column from above, the rest by MED.
+    inline unsigned short prediction(const unsigned short* plane, size_t width, size_t row, size_t column) {
+        const unsigned short* pSample = plane + row * width + column;
+        if (row == 0) return column ? pSample[-1] : 0;
+        if (column == 0) return pSample[-(int)width];
+        return predictMED(pSample[-1], pSample[-(int)width], pSample[-(int)width - 1]);
+    }
+}
+
+const int PlanetHalfCodec::BLOCK_SIZE = 16;
+
+bool PlanetHalfCodec::canEncode(const Image& image) {
+    PixelFormat format = image.getFormat();
+    return format == PF_FLOAT16_R || format == PF_FLOAT16_RGB || format == PF_FLOAT16_RGBA;
+}
+
+/**
+ * Append the compressed image to data.
+ */
+void PlanetHalfCodec::encode(const Image& image, std::vector<uchar>& data) {
+    assert(canEncode(image));
+
+    Header header;
+    header.mFormat = image.getFormat();
+    header.mWidth = image.getWidth();
+    header.mHeight = image.getHeight();
+    data.insert(data.end(), (const uchar*)&header, (const uchar*)(&header + 1));
+
+    size_t channels = PixelUtil::getComponentCount(image.getFormat());
+    size_t count = header.mWidth * header.mHeight;
+    const unsigned short* samples = (const unsigned short*)image.getData();
+
+    std::vector<unsigned short> plane(count), residuals(count);
+    for (size_t channel = 0; channel < channels; ++channel) {
+        const unsigned short* pIn = samples + channel;
+        for (size_t i = 0; i < count; ++i) {
+            plane[i] = toOrdered(*pIn);
+            pIn += channels;
+        }
+        predict(&plane[0], header.mWidth, header.mHeight, &residuals[0]);
+        pack(&residuals[0], count, data);
+    }
+}
+
+/**
+ * Decode an image from encode(). The image data is allocated with OGRE_ALLOC_T and owned by
+ * the caller. Returns false if the data is damaged.
+ */
+bool PlanetHalfCodec::decode(const uchar* data, size_t size, Image& image) {
+    if (size < sizeof(Header)) return false;
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+
+    PixelFormat format = (PixelFormat)header.mFormat;
+    if (format != PF_FLOAT16_R && format != PF_FLOAT16_RGB && format != PF_FLOAT16_RGBA) return false;
+    if (header.mWidth > 8192 || header.mHeight > 8192) return false;
+
+    size_t channels = PixelUtil::getComponentCount(format);
+    size_t count = header.mWidth * header.mHeight;
+    const uchar* pIn = data + sizeof(Header);
+    const uchar* end = data + size;
+
+    unsigned short* samples = OGRE_ALLOC_T(unsigned short, count * channels, MEMCATEGORY_GENERAL);
+    std::vector<unsigned short> plane(count), residuals(count);
+    for (size_t channel = 0; channel < channels; ++channel) {
+        pIn = unpack(pIn, end, count, &residuals[0]);
+        if (!pIn) {
+            OGRE_FREE(samples, MEMCATEGORY_GENERAL);
+            return false;
+        }
+        reconstruct(&residuals[0], header.mWidth, header.mHeight, &plane[0]);
+
+        unsigned short* pOut = samples + channel;
+        for (size_t i = 0; i < count; ++i) {
+            *pOut = fromOrdered(plane[i]);
+            pOut += channels;
+        }
+    }
+
+    image = Image().loadDynamicImage((uchar*)samples, header.mWidth, header.mHeight, 1, format, false, 1, 0);
+    return true;
+}
+
+void PlanetHalfCodec::predict(const unsigned short* plane, size_t width, size_t height, unsigned short* residuals) {
+    for (size_t row = 0; row < height; ++row) {
+        for (size_t column = 0; column < width; ++column) {
+            *residuals++ = zigzag(plane[row * width + column] - prediction(plane, width, row, column));
+        }
+    }
+}
+
+/**
+ * Inverse of predict(), in the same order, so each prediction only sees decoded samples.
+ */
+void PlanetHalfCodec::reconstruct(const unsigned short* residuals, size_t width, size_t height, unsigned short* plane) {
+    for (size_t row = 0; row < height; ++row) {
+        for (size_t column = 0; column < width; ++column) {
+            plane[row * width + column] = prediction(plane, width, row, column) + unzigzag(*residuals++);
+        }
+    }
+}
+
+/**
+ * Per block: one byte of bit width, then the residuals at that width, LSB first, padded to
+ * a whole byte.
+ */
+void PlanetHalfCodec::pack(const unsigned short* residuals, size_t count, std::vector<uchar>& data) {
+    for (size_t block = 0; block < count; block += BLOCK_SIZE) {
+        size_t length = std::min((size_t)BLOCK_SIZE, count - block);
+        const unsigned short* pIn = residuals + block;
+
+        unsigned short bits = 0;
+        for (size_t i = 0; i < length; ++i) {
+            bits |= pIn[i];
+        }
+        int width = 0;
+        while (bits >> width) {
+            width++;
+        }
+        data.push_back((uchar)width);
+
+        uint32 buffer = 0;
+        int buffered = 0;
+        for (size_t i = 0; i < length; ++i) {
+            buffer |= (uint32)pIn[i] << buffered;
+            buffered += width;
+            while (buffered >= 8) {
+                data.push_back((uchar)buffer);
+                buffer >>= 8;
+                buffered -= 8;
+            }
+        }
+        if (buffered > 0) {
+            data.push_back((uchar)buffer);
+        }
+    }
+}
+
+/**
+ * Inverse of pack(). Returns the end of the packed data, or 0 if it's damaged.
+ */
+const uchar* PlanetHalfCodec::unpack(const uchar* data, const uchar* end, size_t count, unsigned short* residuals) {
+    for (size_t block = 0; block < count; block += BLOCK_SIZE) {
+        size_t length = std::min((size_t)BLOCK_SIZE, count - block);
+        unsigned short* pOut = residuals + block;
+
+        if (data == end) return 0;
+        int width = *data++;
+        if (width > 16) return 0;
+        if ((size_t)(end - data) < (length * width + 7) / 8) return 0;
+
+        uint32 mask = (1 << width) - 1;
+        uint32 buffer = 0;
+        int buffered = 0;
+        for (size_t i = 0; i < length; ++i) {
+            while (buffered < width) {
+                buffer |= (uint32)*data++ << buffered;
+                buffered += 8;
+            }
+            pOut[i] = (unsigned short)(buffer & mask);
+            buffer >>= width;
+            buffered -= width;
+        }
+    }
+    return data;
+}
+
+};
@@ -0,0 +1,52 @@
+/*
+ *  PlanetHalfCodec.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetHalfCodec_H
+#define PlanetHalfCodec_H
+
+#include <Ogre/Ogre.h>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Lossless codec for half float tile images (PF_FLOAT16_R, _RGB or _RGBA).
+     *
+     * Channels are coded as separate planes. Half bit patterns are first remapped so their
+     * integer order matches their float order (sign-magnitude to offset binary). Each sample
+     * is then predicted from its left, upper and upper-left neighbours with the median edge
+     * detector of LOCO-I, and the residual is zigzag coded. Residuals are bit-packed in blocks
+     * of BLOCK_SIZE, each block at the width of its largest residual: smooth terrain spends a
+     * few bits per sample, and a rough block never costs more than 16.
+     */
+    class PlanetHalfCodec {
+    public:
+        static const int BLOCK_SIZE;
+
+        static bool canEncode(const Image& image);
+        static void encode(const Image& image, std::vector<uchar>& data);
+        static bool decode(const uchar* data, size_t size, Image& image);
+
+    protected:
+        struct Header {
+            uint32 mFormat;
+            uint32 mWidth;
+            uint32 mHeight;
+        };
+
+        static void predict(const unsigned short* plane, size_t width, size_t height, unsigned short* residuals);
+        static void reconstruct(const unsigned short* residuals, size_t width, size_t height, unsigned short* plane);
+        static void pack(const unsigned short* residuals, size_t count, std::vector<uchar>& data);
+        static const uchar* unpack(const uchar* data, const uchar* end, size_t count, unsigned short* residuals);
+    };
+
+};
+
+#endif
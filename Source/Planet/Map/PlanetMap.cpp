@@ -8,19 +8,32 @@
  */
 
 #include "PlanetMap.h"
+#include "PlanetCube.h"
 
-#include "Application.h"
+#include "EngineState.h"
+#include "PlanetHalfCodec.h"
 #include "Utility.h"
 
+#include <algorithm>
+
 namespace NFSpace {
 
-PlanetMap::PlanetMap(PlanetDescriptor* descriptor) : mDescriptor(descriptor), mStep(0) {
+PlanetMap::PlanetMap(PlanetDescriptor* descriptor)
+: mDescriptor(descriptor), mGenerator(0), mBrushIndex(0), mBaseMap(0), mScript(0), mWorkers(0), mCache(0), mMemoryCache(0), mStoreWorkers(0), mRound(0), mReadback(0) {
+    mBackend = (getString("planet.mapBackend") == "CPU") ? BACKEND_CPU : BACKEND_GPU;
+    // Scripted terrain has detail at every scale, so it can't build on a parent tile.
+    mUpsample = mBackend == BACKEND_CPU && getBool("planet.mapUpsample") && mDescriptor->script.empty();
+
+    initCache();
     initHelperScene();
     initBuffers();
+    initWorkers();
     prepareHeightMap();
 }
 
 PlanetMap::~PlanetMap() {
+    deleteWorkers();
+    deleteCache();
     deleteHeightMap();
     deleteBuffers();
     deleteHelperScene();
@@ -41,25 +54,296 @@ void PlanetMap::deleteHelperScene() {
 }
 
 void PlanetMap::initBuffers() {
-    for (int i = 0; i < 2; ++i) {
-        mMapBuffer[i] = new PlanetMapBuffer(mSceneManager,
-                                            mCamera,
-                                            getInt("planet.textureSize"),
-                                            1,
-                                            0.5f);
+    if (mBackend == BACKEND_CPU) {
+        mGenerator = new PlanetMapGenerator(getInt("planet.textureSize"), 1, 0.5f);
+        return;
     }
-}
 
-void PlanetMap::swapBuffers() {
-    PlanetMapBuffer* temp = mMapBuffer[1];
-    mMapBuffer[1] = mMapBuffer[0];
-    mMapBuffer[0] = temp;
+    // One pair of working buffers per tile in flight.
+    int slots = maxi(1, getInt("planet.mapPipeline"));
+    for (int i = 0; i < slots; ++i) {
+        TileSlot* slot = new TileSlot();
+        slot->mNode = 0;
+        slot->mStep = 0;
+        slot->mRound = -1;
+        slot->mTicket = -1;
+        slot->mNormalTicket = -1;
+        for (int j = 0; j < 2; ++j) {
+            slot->mMapBuffer[j] = new PlanetMapBuffer(mSceneManager,
+                                                      mCamera,
+                                                      getInt("planet.textureSize"),
+                                                      1,
+                                                      0.5f);
+        }
+        mSlots.push_back(slot);
+    }
+
+    // Each slot has at most one readback in flight, two if normals are cached too.
+    mReadback = PlanetReadback::create(getString("planet.mapReadback"), (mCache || mMemoryCache) ? slots * 2 : slots);
 }
-    
+
 void PlanetMap::deleteBuffers() {
-    for (int i = 0; i < 2; ++i) {
-        delete mMapBuffer[i];
+    for (TileSlotList::iterator it = mSlots.begin(); it != mSlots.end(); ++it) {
+        TileSlot* slot = *it;
+        releaseSlot(slot);
+        for (int j = 0; j < 2; ++j) {
+            delete slot->mMapBuffer[j];
+        }
+        delete slot;
+    }
+    mSlots.clear();
+    delete mReadback;
+    mReadback = 0;
+    if (mGenerator) {
+        delete mGenerator;
+    }
+}
+
+/**
+ * Slot holding this node's tile, or a free slot for node = 0.
+ */
+PlanetMap::TileSlot* PlanetMap::findSlot(QuadTreeNode* node) const {
+    for (TileSlotList::const_iterator it = mSlots.begin(); it != mSlots.end(); ++it) {
+        if ((*it)->mNode == node) {
+            return *it;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Free a slot, cleaning up whatever its tile had produced so far.
+ */
+void PlanetMap::releaseSlot(TileSlot* slot) {
+    if (slot->mStep > STEP_SAVE_HEIGHT) {
+        TextureManager::getSingleton().remove(slot->mHeightTexture->getName());
+    }
+    if (slot->mTicket >= 0) {
+        mReadback->cancel(slot->mTicket);
+        slot->mTicket = -1;
+    }
+    if (slot->mNormalTicket >= 0) {
+        mReadback->cancel(slot->mNormalTicket);
+        slot->mNormalTicket = -1;
+    }
+    if (slot->mNormalImage.getData()) {
+        OGRE_FREE(slot->mNormalImage.getData(), MEMCATEGORY_GENERAL);
+    }
+    if (slot->mStep > STEP_SAVE_NORMAL) {
+        TextureManager::getSingleton().remove(slot->mNormalTexture->getName());
+    }
+    if (slot->mHeightImage.getData()) {
+        OGRE_FREE(slot->mHeightImage.getData(), MEMCATEGORY_GENERAL);
+    }
+    slot->mHeightTexture.setNull();
+    slot->mHeightImage = Image();
+    slot->mNormalTexture.setNull();
+    slot->mNormalImage = Image();
+    slot->mNode = 0;
+    slot->mStep = 0;
+}
+
+void PlanetMap::initCache() {
+    int retain = getInt("planet.tileRetainMB");
+    if (retain > 0) {
+        mMemoryCache = new PlanetTileMemoryCache((size_t)retain << 20);
+    }
+
+    String path = getString("planet.tileCache");
+    if (!path.empty()) {
+        // Anything besides the descriptor that changes what tiles look like.
+        String settings = PlanetTileCache::getSettings(mBackend == BACKEND_CPU ? "CPU" : "GPU", getInt("planet.textureSize"), mUpsample);
+        mCache = new PlanetTileCache(path, *mDescriptor, settings);
+    }
+
+    // Encoding and writing tiles stays off the main thread.
+    if (mCache || mMemoryCache) {
+        mStoreWorkers = new PlanetMapWorkers(1);
+    }
+}
+
+void PlanetMap::deleteCache() {
+    for (CachedTileMap::iterator it = mCachedTiles.begin(); it != mCachedTiles.end(); ++it) {
+        freeCachedTile(it->second);
+    }
+    mCachedTiles.clear();
+
+    if (mStoreWorkers) {
+        // Let queued tiles reach the disk cache before it's packed.
+        mStoreWorkers->finish();
+        collectStores();
+        delete mStoreWorkers;
+        mStoreWorkers = 0;
+    }
+
+    if (mCache && mCache->getStoredCount() > 0 && mCache->getStoredCount() >= getInt("planet.tilePackThreshold")) {
+        // All tiles are gone by now, so the pack can be rebuilt with the loose tiles.
+        mCache->pack();
+    }
+    delete mCache;
+    mCache = 0;
+    delete mMemoryCache;
+    mMemoryCache = 0;
+}
+
+void PlanetMap::freeCachedTile(CachedTile& tile) {
+    if (tile.mMapped) return;
+    OGRE_FREE(tile.mHeightImage.getData(), MEMCATEGORY_GENERAL);
+    OGRE_FREE(tile.mNormalImage.getData(), MEMCATEGORY_GENERAL);
+}
+
+/**
+ * Look for a tile in the memory cache, then the disk cache, unless it's already being built.
+ */
+bool PlanetMap::loadCachedTile(QuadTreeNode* node) {
+    if (mCachedTiles.find(node) != mCachedTiles.end()) return true;
+    if (mWorkers ? mJobs.find(node) != mJobs.end() : findSlot(node) != 0) return false;
+
+    CachedTile tile;
+    tile.mMapped = false;
+    if (!(mMemoryCache && mMemoryCache->load(node->mFace, node->mLOD, node->mX, node->mY, tile.mHeightImage, tile.mNormalImage)) &&
+        !(mCache && mCache->load(node->mFace, node->mLOD, node->mX, node->mY, tile.mHeightImage, tile.mNormalImage, tile.mMapped))) {
+        return false;
     }
+    mCachedTiles.insert(CachedTileMap::value_type(node, tile));
+    return true;
+}
+
+/**
+ * Queue a newly built tile for the caches, so it doesn't have to be built again. Takes over
+ * the normal image, the height image stays with the tile and is copied.
+ */
+void PlanetMap::storeTile(QuadTreeNode* node, const Image& heightImage, Image& normalImage) {
+    if (!mStoreWorkers || !PlanetHalfCodec::canEncode(heightImage) || !PlanetHalfCodec::canEncode(normalImage)) return;
+
+    mStoreWorkers->submit(new StoreJob(this, node, heightImage, normalImage));
+    normalImage = Image();
+}
+
+/**
+ * Hand encoded tiles to the memory cache. Both tiers hold the same PlanetHalfCodec data, so
+ * each tile is encoded once.
+ */
+void PlanetMap::collectStores() {
+    PlanetMapWorkers::JobList finished;
+    mStoreWorkers->collect(finished);
+
+    for (PlanetMapWorkers::JobList::iterator it = finished.begin(); it != finished.end(); ++it) {
+        StoreJob* job = static_cast<StoreJob*>(*it);
+        if (job->mWritten) {
+            mCache->addStored();
+        }
+        if (mMemoryCache) {
+            mMemoryCache->store(job->mFace, job->mLOD, job->mX, job->mY, job->mHeightData, job->mNormalData);
+        }
+        delete job;
+    }
+}
+
+void PlanetMap::initWorkers() {
+    if (mBackend != BACKEND_CPU) return;
+
+    // 0 = one thread per core.
+    int threads = getInt("planet.mapThreads");
+    if (threads <= 0) {
+        threads = getProcessorCount();
+    }
+    mWorkers = new PlanetMapWorkers(threads);
+}
+
+void PlanetMap::deleteWorkers() {
+    if (!mWorkers) return;
+
+    // Waits for running jobs, and discards any jobs still held by the pool.
+    delete mWorkers;
+    mWorkers = 0;
+
+    // Jobs that were already collected are ours to clean up.
+    for (TileJobMap::iterator it = mJobs.begin(); it != mJobs.end(); ++it) {
+        if (it->second->mFinished) {
+            delete it->second;
+        }
+    }
+    mJobs.clear();
+}
+
+void PlanetMap::collectJobs() {
+    PlanetMapWorkers::JobList finished;
+    mWorkers->collect(finished);
+
+    for (PlanetMapWorkers::JobList::iterator it = finished.begin(); it != finished.end(); ++it) {
+        TileJob* job = static_cast<TileJob*>(*it);
+        if (job->mCancelled) {
+            // Node no longer wants this tile.
+            delete job;
+        }
+        else {
+            job->mFinished = true;
+            mFinishedTiles.push_back(job->mNode);
+        }
+    }
+}
+
+bool PlanetMap::isAsync() const {
+    return mWorkers != 0 || !mSlots.empty();
+}
+
+/**
+ * Whether a tile for this node is building on the workers.
+ */
+bool PlanetMap::isTilePending(QuadTreeNode* node) const {
+    if (!mWorkers) {
+        TileSlot* slot = findSlot(node);
+        return slot && slot->mStep < TILE_STEPS;
+    }
+    TileJobMap::const_iterator it = mJobs.find(node);
+    return it != mJobs.end() && !it->second->mFinished;
+}
+
+/**
+ * Nodes whose tiles finished building since the last call, ready for finalizeTile.
+ */
+void PlanetMap::collectTiles(std::vector<QuadTreeNode*>& finished) {
+    if (mWorkers) {
+        collectJobs();
+    }
+    if (mStoreWorkers) {
+        collectStores();
+    }
+    finished.swap(mFinishedTiles);
+    mFinishedTiles.clear();
+}
+
+/**
+ * Run the next GPU pipeline step. Returns false if no tile in flight can make progress,
+ * i.e. there are none or they're all waiting on readbacks.
+ *
+ * Steps are issued in rounds: each tile in flight advances once per round, furthest along
+ * first. So while one tile is read back, the next is being copied out and a new one
+ * rendered, and the driver gets a round's worth of other work before each readback.
+ */
+bool PlanetMap::stepTiles() {
+    for (int pass = 0; pass < 2; ++pass) {
+        for (;;) {
+            TileSlot* next = 0;
+            for (TileSlotList::iterator it = mSlots.begin(); it != mSlots.end(); ++it) {
+                TileSlot* slot = *it;
+                if (!slot->mNode || slot->mStep >= TILE_STEPS || slot->mRound == mRound) continue;
+                if (!next || slot->mStep > next->mStep) {
+                    next = slot;
+                }
+            }
+            if (!next) break;
+
+            next->mRound = mRound;
+            if (runStep(next)) {
+                return true;
+            }
+        }
+        // Everything moved (or tried to) this round, start the next one.
+        mRound++;
+    }
+    return false;
 }
     
 void PlanetMap::prepareHeightMap() {
@@ -74,20 +358,42 @@ void PlanetMap::prepareHeightMap() {
 #endif
     
     mHeightMapBrushes = mSceneManager->getRootSceneNode()->createChildSceneNode("heightMapBrushes");
+    mHeightMapBatch = new PlanetBrush();
+    mHeightMapBrushes->attachObject(mHeightMapBatch);
     mHeightMapBrushes->setVisible(false, false);
 
-    Vector3 position, rand, up;
-    
-    // TODO: run real script w/ real descriptor
-    
+    if (!mDescriptor->script.empty()) {
+        if (mBackend == BACKEND_CPU) {
+            // The workers and store thread are already running, so don't let a bad script
+            // escape the constructor.
+            try {
+                mScript = new PlanetTerrainScript(mDescriptor->script, mDescriptor->seed);
+                mGenerator->setScript(mScript);
+            }
+            catch (Exception& e) {
+                log("Terrain script failed, drawing brushes only: " + e.getDescription());
+            }
+        }
+        else {
+            log("Terrain scripts need planet.mapBackend CPU, drawing brushes only.");
+        }
+    }
+
     // Draw N random brushes.
-    srand(mDescriptor->seed);
-    for (int i = 0; i < mDescriptor->brushes; ++i) {
-        position = Vector3((randf() * 2 - 1), (randf() * 2 - 1), (randf() * 2 - 1));
-        position.normalise();
-        up = Vector3(randf() * 2 - 1, randf() * 2 - 1, randf() * 2 - 1);
-        float scale = randf() * .95 + .05;
-        drawBrush(mHeightMapBrushes, position, Vector2(scale, scale * (randf() + .5)), up);
+    mBrushTable.generate(mDescriptor->seed, mDescriptor->brushes);
+
+    if (mBackend == BACKEND_CPU && mDescriptor->baseMapSize > 0) {
+        // Bake the large brushes once, tiles only rasterize what's left.
+        PlanetBrushTable::BrushSet baked, live;
+        PlanetBaseMap::splitBrushes(mBrushTable, mDescriptor->baseMapThreshold, baked, live);
+        mBaseMap = new PlanetBaseMap(mBrushTable, baked, mDescriptor->baseMapSize, mWorkers);
+        mGenerator->setBaseMap(mBaseMap);
+
+        mBrushIndex = new PlanetBrushIndex(mBrushTable, live, getInt("planet.textureSize"), 1);
+    }
+    else {
+        // Index brushes by the tiles they touch.
+        mBrushIndex = new PlanetBrushIndex(mBrushTable, getInt("planet.textureSize"), 1);
     }
 
 #ifdef NF_DEBUG_TIMING
@@ -100,6 +406,18 @@ void PlanetMap::prepareHeightMap() {
 }
 
 void PlanetMap::deleteHeightMap() {
+    delete mBrushIndex;
+    mBrushIndex = 0;
+    if (mGenerator) {
+        mGenerator->setBaseMap(0);
+        mGenerator->setScript(0);
+    }
+    delete mBaseMap;
+    mBaseMap = 0;
+    delete mScript;
+    mScript = 0;
+    mBrushTable.clear();
+
     SceneNode::ObjectIterator it = mHeightMapBrushes->getAttachedObjectIterator();
     while (it.hasMoreElements()) {
         delete it.getNext();
@@ -109,91 +427,318 @@ void PlanetMap::deleteHeightMap() {
     mSceneManager->destroySceneNode(mHeightMapBrushes);
 }
     
-void PlanetMap::resetTile() {
-    if (mStep > 1) {
-        TextureManager::getSingleton().remove(mHeightTexture->getName());
+void PlanetMap::resetTile(QuadTreeNode* node) {
+    mFinishedTiles.erase(std::remove(mFinishedTiles.begin(), mFinishedTiles.end(), node), mFinishedTiles.end());
+
+    CachedTileMap::iterator cached = mCachedTiles.find(node);
+    if (cached != mCachedTiles.end()) {
+        freeCachedTile(cached->second);
+        mCachedTiles.erase(cached);
     }
-    if (mStep > 2) {
-        OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+
+    if (mWorkers) {
+        TileJobMap::iterator it = mJobs.find(node);
+        if (it != mJobs.end()) {
+            TileJob* job = it->second;
+            mJobs.erase(it);
+            // Jobs still in the pool are deleted when collected.
+            job->mCancelled = true;
+            if (job->mFinished) {
+                delete job;
+            }
+        }
+        return;
+    }
+
+    TileSlot* slot = findSlot(node);
+    if (slot) {
+        releaseSlot(slot);
     }
-    mStep = 0;
 }
 
 bool PlanetMap::prepareTile(QuadTreeNode* node) {
+#ifdef NF_DEBUG_TIMING
     int face = node->mFace,
         lod  = node->mLOD,
         x    = node->mX,
         y    = node->mY;
-
-#ifdef NF_DEBUG_TIMING
     std::ostringstream msg;
     
     msg.str("");
     msg << "generateTile ("
     << face << ", " << lod << ", " << x << ", " << y << ") @ "
-    << getInt("planet.textureSize") << "x" << getInt("planet.textureSize")
+    << getInt("planet.textureSize") << "x" << getInt("planet.textureSize");
     log(msg.str());
-    
+#endif
+
+    if ((mCache || mMemoryCache) && loadCachedTile(node)) {
+        return true;
+    }
+
+    if (mWorkers) {
+        collectJobs();
+
+        TileJobMap::iterator it = mJobs.find(node);
+        if (it == mJobs.end()) {
+            // Don't queue up more work than the pool can get through.
+            if (mJobs.size() >= (size_t)mWorkers->getThreadCount() * 2) {
+                return false;
+            }
+            TileJob* job = new TileJob(this, node);
+            mJobs.insert(TileJobMap::value_type(node, job));
+            mWorkers->submit(job);
+            return false;
+        }
+        return it->second->mFinished;
+    }
+
+    TileSlot* slot = findSlot(node);
+    if (!slot) {
+        // Claim a free pair of buffers, stepTiles() takes it from there.
+        slot = findSlot(0);
+        if (slot) {
+            slot->mNode = node;
+            slot->mStep = 0;
+            slot->mRound = -1;
+        }
+        return false;
+    }
+    return slot->mStep >= TILE_STEPS;
+}
+
+/**
+ * Advance a tile by one step. Returns false if it's waiting on its readback instead.
+ */
+bool PlanetMap::runStep(TileSlot* slot) {
+    QuadTreeNode* node = slot->mNode;
+    int face = node->mFace,
+        lod  = node->mLOD,
+        x    = node->mX,
+        y    = node->mY;
+    PlanetMapBuffer** buffers = slot->mMapBuffer;
+
+#ifdef NF_DEBUG_TIMING
+    std::ostringstream msg;
     unsigned long delta, start = Root::getSingleton().getTimer()->getMilliseconds();
 #endif
-    
-    switch (mStep) {
-        case 0:
+
+    switch (slot->mStep) {
+        case STEP_RENDER_HEIGHT:
             // Generate height texture in working buffer.
-            mMapBuffer[FRONT]->render(face, lod, x, y, mHeightMapBrushes);
-            //saveTexture(mMapBuffer[FRONT]->mTexture);
+            {
+                // Batch up the brushes that touch this tile.
+                PlanetBrushTable::BrushSet brushes;
+                mBrushIndex->query(face, lod, x, y, brushes);
+                mHeightMapBatch->update(mBrushTable, brushes);
+            }
+            buffers[FRONT]->render(face, lod, x, y, mHeightMapBrushes);
+            //saveTexture(buffers[FRONT]->mTexture);
             break;
         
-        case 1:
+        case STEP_SAVE_HEIGHT:
             // Save height texture.
-            mHeightTexture = mMapBuffer[FRONT]->saveTexture(false, PlanetMapBuffer::MAP_TYPE_HEIGHT);
+            slot->mHeightTexture = buffers[FRONT]->saveTexture(false, PlanetMapBuffer::MAP_TYPE_HEIGHT);
             //saveTexture(heightTexture);
             break;
         
-        case 2:
-            // Download height texture to Image().
-            mHeightImage = mMapBuffer[FRONT]->saveImage(false, PlanetMapBuffer::MAP_TYPE_HEIGHT);
+        case STEP_ISSUE_READBACK:
+            // Start downloading the height texture, collected in STEP_MAP_READBACK.
+            slot->mTicket = buffers[FRONT]->issueImage(mReadback);
+            if (slot->mTicket < 0) return false;
             break;
 
-        case 3:
+        case STEP_FILTER_NORMAL:
             // Generate normal map.
-            mMapBuffer[BACK]->filter(face, lod, x, y, PlanetMapBuffer::FILTER_TYPE_NORMAL, mMapBuffer[FRONT]);
+            buffers[BACK]->filter(face, lod, x, y, PlanetMapBuffer::FILTER_TYPE_NORMAL, buffers[FRONT]);
             break;
             
-        case 4:
+        case STEP_SAVE_NORMAL:
+            if (mCache || mMemoryCache) {
+                // Download the normals too, for the tile caches.
+                slot->mNormalTicket = buffers[BACK]->issueImage(mReadback);
+                if (slot->mNormalTicket < 0) return false;
+            }
             // Save normal texture.
-            mNormalTexture = mMapBuffer[BACK]->saveTexture(false, PlanetMapBuffer::MAP_TYPE_NORMAL);
+            slot->mNormalTexture = buffers[BACK]->saveTexture(false, PlanetMapBuffer::MAP_TYPE_NORMAL);
+            break;
+
+        case STEP_MAP_READBACK:
+            // Fetch the height image to Image(), once it's arrived. The normals too, for the caches.
+            if (!mapReadback(buffers[FRONT], slot->mTicket, slot->mHeightImage, PlanetMapBuffer::MAP_TYPE_HEIGHT)) return false;
+            if ((mCache || mMemoryCache) &&
+                !mapReadback(buffers[BACK], slot->mNormalTicket, slot->mNormalImage, PlanetMapBuffer::MAP_TYPE_NORMAL)) return false;
             break;
     }
 #ifdef NF_DEBUG_TIMING
     delta = Root::getSingleton().getTimer()->getMilliseconds() - start;
     msg.str("");
-    msg << " => Step " << mStep << " (" << delta << "ms)";
+    msg << " => Step " << slot->mStep << " (" << delta << "ms)";
     log(msg.str());
 #endif
 
-    mStep++;
-    return mStep > 4;
+    slot->mStep++;
+    if (slot->mStep >= TILE_STEPS) {
+        mFinishedTiles.push_back(node);
+    }
+    return true;
+}
+
+/**
+ * Map one of a slot's readbacks into image, once it's arrived. A readback that failed to map
+ * is issued again from the buffer, which still holds the tile. Returns true once image is set.
+ */
+bool PlanetMap::mapReadback(PlanetMapBuffer* buffer, PlanetReadback::Ticket& ticket, Image& image, int type) {
+    if (image.getData()) return true;
+    if (ticket < 0) {
+        ticket = buffer->issueImage(mReadback);
+        return false;
+    }
+    if (!mReadback->poll(ticket)) return false;
+
+    image = buffer->mapImage(mReadback, ticket, false, type);
+    ticket = -1;
+    if (!image.getData()) {
+        ticket = buffer->issueImage(mReadback);
+        return false;
+    }
+    return true;
 }
 
 PlanetMapTile* PlanetMap::finalizeTile(QuadTreeNode* node) {
-    mStep = 0;
-    return new PlanetMapTile(node, mHeightTexture, mHeightImage, mNormalTexture, getInt("planet.textureSize"));
+    mFinishedTiles.erase(std::remove(mFinishedTiles.begin(), mFinishedTiles.end(), node), mFinishedTiles.end());
+
+    TexturePtr heightTexture;
+    Image heightImage;
+    TexturePtr normalTexture;
+    bool ownHeightImage = true;
+
+    CachedTileMap::iterator cached = mCachedTiles.find(node);
+    if (cached != mCachedTiles.end()) {
+        // Upload the cached images.
+        heightTexture = PlanetMapBuffer::loadTexture(cached->second.mHeightImage, PlanetMapBuffer::MAP_TYPE_HEIGHT);
+        normalTexture = PlanetMapBuffer::loadTexture(cached->second.mNormalImage, PlanetMapBuffer::MAP_TYPE_NORMAL);
+
+        // Tile takes ownership of the height image, or wraps the pack's copy.
+        heightImage = cached->second.mHeightImage;
+        ownHeightImage = !cached->second.mMapped;
+        if (ownHeightImage) {
+            OGRE_FREE(cached->second.mNormalImage.getData(), MEMCATEGORY_GENERAL);
+        }
+        mCachedTiles.erase(cached);
+    }
+    else if (mWorkers) {
+        TileJobMap::iterator it = mJobs.find(node);
+        assert(it != mJobs.end() && it->second->mFinished);
+        TileJob* job = it->second;
+        mJobs.erase(it);
+
+        // Hand off CPU results to the GPU.
+        heightTexture = PlanetMapBuffer::loadTexture(job->mHeightImage, PlanetMapBuffer::MAP_TYPE_HEIGHT);
+        normalTexture = PlanetMapBuffer::loadTexture(job->mNormalImage, PlanetMapBuffer::MAP_TYPE_NORMAL);
+        storeTile(node, job->mHeightImage, job->mNormalImage);
+
+        // Tile takes ownership of the height image.
+        heightImage = job->mHeightImage;
+        job->mHeightImage = Image();
+        delete job;
+    }
+    else {
+        TileSlot* slot = findSlot(node);
+        assert(slot && slot->mStep >= TILE_STEPS);
+
+        if (slot->mNormalImage.getData()) {
+            storeTile(node, slot->mHeightImage, slot->mNormalImage);
+        }
+        if (slot->mNormalImage.getData()) {
+            OGRE_FREE(slot->mNormalImage.getData(), MEMCATEGORY_GENERAL);
+        }
+
+        // Tile takes ownership of the slot's results, the buffers are free for the next one.
+        heightTexture = slot->mHeightTexture;
+        heightImage = slot->mHeightImage;
+        normalTexture = slot->mNormalTexture;
+        slot->mHeightTexture.setNull();
+        slot->mHeightImage = Image();
+        slot->mNormalTexture.setNull();
+        slot->mNormalImage = Image();
+        slot->mNode = 0;
+        slot->mStep = 0;
+    }
+
+    return new PlanetMapTile(node, heightTexture, heightImage, normalTexture, getInt("planet.textureSize"), ownHeightImage);
 }
 
-void PlanetMap::drawBrush(SceneNode* brushesNode, Vector3 position, Vector2 scale, Vector3 up) {
-    PlanetBrush* brush = new PlanetBrush();
-    SceneNode* node = brushesNode->createChildSceneNode();
-    node->setPosition(position);
-    node->setScale(scale.x, scale.y, 1);
-    
-    Vector3 right = position.crossProduct(up);
-    Vector3 front = position.crossProduct(right);
-    up = right.crossProduct(front);
-    right.normalise(); front.normalise(); up.normalise();
-    node->setOrientation(Quaternion(right, front, up));
-    
-    node->attachObject(brush);
+PlanetMap::TileJob::TileJob(PlanetMap* map, QuadTreeNode* node)
+: mMap(map), mNode(node), mFace(node->mFace), mLOD(node->mLOD), mX(node->mX), mY(node->mY), mFinished(false) {
+    mWorkspace = OGRE_ALLOC_T(float, mMap->mGenerator->getWorkspaceSize(), MEMCATEGORY_GENERAL);
+
+    // Copy the parent's heights if we can build on them, it may be paged out while we run.
+    if (mMap->mUpsample && node->mParent && node->mParent->mMapTile) {
+        Image* parent = node->mParent->mMapTile->getHeightMap();
+        if (parent->getData()) {
+            uchar* data = OGRE_ALLOC_T(uchar, parent->getSize(), MEMCATEGORY_GENERAL);
+            memcpy(data, parent->getData(), parent->getSize());
+            mParentImage.loadDynamicImage(data, parent->getWidth(), parent->getHeight(), 1, parent->getFormat(), false, 1, 0);
+        }
+    }
+}
+
+PlanetMap::TileJob::~TileJob() {
+    OGRE_FREE(mWorkspace, MEMCATEGORY_GENERAL);
+    if (mParentImage.getData()) {
+        OGRE_FREE(mParentImage.getData(), MEMCATEGORY_GENERAL);
+    }
+    if (mHeightImage.getData()) {
+        OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+    }
+    if (mNormalImage.getData()) {
+        OGRE_FREE(mNormalImage.getData(), MEMCATEGORY_GENERAL);
+    }
+}
+
+void PlanetMap::TileJob::run() {
+    // Only rasterize the brushes that touch this tile.
+    PlanetBrushTable::BrushSet brushes;
+    if (!mMap->mScript || mMap->mScript->usesBrushes()) {
+        mMap->mBrushIndex->query(mFace, mLOD, mX, mY, brushes);
+    }
+
+    const Image* parent = mParentImage.getData() ? &mParentImage : 0;
+    PlanetBrushTable::BrushSet edgeBrushes;
+    if (mMap->mUpsample) {
+        if (parent) {
+            // Texels past the parent's edge are drawn as if there was no parent.
+            edgeBrushes = brushes;
+            mMap->mGenerator->selectBrushes(mMap->mBrushTable, mLOD, false, edgeBrushes);
+        }
+        // Drop brushes the parent already has, or that are too small to see yet.
+        mMap->mGenerator->selectBrushes(mMap->mBrushTable, mLOD, parent != 0, brushes);
+    }
+
+    mMap->mGenerator->generate(mFace, mLOD, mX, mY, mMap->mBrushTable, brushes, mWorkspace, mHeightImage, mNormalImage, parent, &edgeBrushes);
+}
+
+/**
+ * Takes over normalImage, copies heightImage.
+ */
+PlanetMap::StoreJob::StoreJob(PlanetMap* map, QuadTreeNode* node, const Image& heightImage, Image& normalImage)
+: mMap(map), mFace(node->mFace), mLOD(node->mLOD), mX(node->mX), mY(node->mY), mNormalImage(normalImage), mWritten(false) {
+    uchar* data = OGRE_ALLOC_T(uchar, heightImage.getSize(), MEMCATEGORY_GENERAL);
+    memcpy(data, heightImage.getData(), heightImage.getSize());
+    mHeightImage.loadDynamicImage(data, heightImage.getWidth(), heightImage.getHeight(), 1, heightImage.getFormat(), false, 1, 0);
+}
+
+PlanetMap::StoreJob::~StoreJob() {
+    OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+    OGRE_FREE(mNormalImage.getData(), MEMCATEGORY_GENERAL);
+}
+
+void PlanetMap::StoreJob::run() {
+    PlanetHalfCodec::encode(mHeightImage, mHeightData);
+    PlanetHalfCodec::encode(mNormalImage, mNormalData);
+    if (mMap->mCache) {
+        mWritten = mMap->mCache->store(mFace, mLOD, mX, mY, mHeightData, mNormalData);
+    }
 }
 
-};
\ No newline at end of file
+};
@@ -12,12 +12,21 @@
 
 #include <Ogre/Ogre.h>
 #include <Ogre/OgreEntity.h>
+#include <map>
 
 #include "PlanetDescriptor.h"
+#include "PlanetBaseMap.h"
 #include "PlanetBrush.h"
+#include "PlanetBrushIndex.h"
 #include "PlanetFilter.h"
 #include "PlanetMapBuffer.h"
+#include "PlanetMapGenerator.h"
 #include "PlanetMapTile.h"
+#include "PlanetMapWorkers.h"
+#include "PlanetReadback.h"
+#include "PlanetTerrainScript.h"
+#include "PlanetTileCache.h"
+#include "PlanetTileMemoryCache.h"
 
 using namespace Ogre;
 
@@ -34,22 +43,133 @@ public:
         FRONT,
         BACK
     };
+
+    enum {
+        BACKEND_GPU,
+        BACKEND_CPU
+    };
     
     PlanetMap(PlanetDescriptor* descriptor);
     ~PlanetMap();
     
-    void drawBrush(SceneNode* brushesNode, Vector3 position, Vector2 scale, Vector3 up);
-    void resetTile();
+    void resetTile(QuadTreeNode* node);
     bool prepareTile(QuadTreeNode* node);
     PlanetMapTile* finalizeTile(QuadTreeNode* node);
+    bool isAsync() const;
+    bool isTilePending(QuadTreeNode* node) const;
+    void collectTiles(std::vector<QuadTreeNode*>& finished);
+    bool stepTiles();
 
 protected:
+    /**
+     * CPU tile build, run on a worker thread.
+     */
+    class TileJob : public PlanetMapWorkers::Job {
+    public:
+        TileJob(PlanetMap* map, QuadTreeNode* node);
+        virtual ~TileJob();
+        virtual void run();
+
+        PlanetMap* mMap;
+        QuadTreeNode* mNode;
+        int mFace;
+        int mLOD;
+        int mX;
+        int mY;
+
+        float* mWorkspace;
+        Image mParentImage;
+        Image mHeightImage;
+        Image mNormalImage;
+        bool mFinished;
+    };
+    typedef std::map<QuadTreeNode*, TileJob*> TileJobMap;
+
+    /**
+     * Finished tile being encoded for the caches, and written to the disk cache, on the
+     * store worker. Keeps its own copies of the images.
+     */
+    class StoreJob : public PlanetMapWorkers::Job {
+    public:
+        StoreJob(PlanetMap* map, QuadTreeNode* node, const Image& heightImage, Image& normalImage);
+        virtual ~StoreJob();
+        virtual void run();
+
+        PlanetMap* mMap;
+        int mFace;
+        int mLOD;
+        int mX;
+        int mY;
+
+        Image mHeightImage;
+        Image mNormalImage;
+        std::vector<uchar> mHeightData;
+        std::vector<uchar> mNormalData;
+        bool mWritten;
+    };
+
+    /**
+     * GPU tile in flight, with its own pair of working buffers.
+     */
+    struct TileSlot {
+        QuadTreeNode* mNode;
+        int mStep;
+        int mRound;
+        PlanetMapBuffer* mMapBuffer[2];
+        PlanetReadback::Ticket mTicket;
+        PlanetReadback::Ticket mNormalTicket;
+
+        TexturePtr mHeightTexture;
+        Image mHeightImage;
+        TexturePtr mNormalTexture;
+        Image mNormalImage;
+    };
+    typedef std::vector<TileSlot*> TileSlotList;
+
+    /**
+     * Tile read from the memory or disk cache, waiting for finalizeTile. Mapped tiles point
+     * into the disk cache's pack file, the others own their images.
+     */
+    struct CachedTile {
+        Image mHeightImage;
+        Image mNormalImage;
+        bool mMapped;
+    };
+    typedef std::map<QuadTreeNode*, CachedTile> CachedTileMap;
+
+    /**
+     * GPU pipeline steps. The height readback runs while the normal map is made.
+     */
+    enum {
+        STEP_RENDER_HEIGHT,
+        STEP_SAVE_HEIGHT,
+        STEP_ISSUE_READBACK,
+        STEP_FILTER_NORMAL,
+        STEP_SAVE_NORMAL,
+        STEP_MAP_READBACK,
+        TILE_STEPS
+    };
+
+    void initWorkers();
+    void deleteWorkers();
+    void collectJobs();
+
+    void initCache();
+    void deleteCache();
+    bool loadCachedTile(QuadTreeNode* node);
+    void storeTile(QuadTreeNode* node, const Image& heightImage, Image& normalImage);
+    void collectStores();
+    void freeCachedTile(CachedTile& tile);
+
     void initHelperScene();
     void deleteHelperScene();
 
     void initBuffers();
-    void swapBuffers();
     void deleteBuffers();
+    TileSlot* findSlot(QuadTreeNode* node) const;
+    bool runStep(TileSlot* slot);
+    bool mapReadback(PlanetMapBuffer* buffer, PlanetReadback::Ticket& ticket, Image& image, int type);
+    void releaseSlot(TileSlot* slot);
 
     void prepareHeightMap();
     void deleteHeightMap();
@@ -58,15 +178,28 @@ protected:
     SceneManager* mSceneManager;
     Camera* mCamera;
 
-    // These hold work-in-progress
-    int mStep;
-    TexturePtr mHeightTexture;
-    Image mHeightImage;
-    TexturePtr mNormalTexture;
+    int mBackend;
+    PlanetMapGenerator* mGenerator;
+    bool mUpsample;
+    PlanetBrushTable mBrushTable;
+    PlanetBrushIndex* mBrushIndex;
+    PlanetBaseMap* mBaseMap;
+    PlanetTerrainScript* mScript;
+    PlanetMapWorkers* mWorkers;
+    TileJobMap mJobs;
+    std::vector<QuadTreeNode*> mFinishedTiles;
+    PlanetTileCache* mCache;
+    PlanetTileMemoryCache* mMemoryCache;
+    PlanetMapWorkers* mStoreWorkers;
+    CachedTileMap mCachedTiles;
+
+    // GPU tiles in progress, advanced one step at a time by stepTiles().
+    TileSlotList mSlots;
+    int mRound;
+    PlanetReadback* mReadback;
     
     SceneNode* mHeightMapBrushes;
-
-    PlanetMapBuffer* mMapBuffer[2];
+    PlanetBrush* mHeightMapBatch;
 };
     
 };
@@ -10,7 +10,7 @@
 #include "PlanetMapBuffer.h"
 #include "PlanetCube.h"
 
-#include "Application.h"
+#include "EngineState.h"
 #include "Utility.h"
 #include "Planet.h"
 #include "PlanetEdgeFixup.h"
@@ -103,17 +103,8 @@ TexturePtr PlanetMapBuffer::saveTexture(bool border, int type) {
     // Alloc write once texture at right size
     int size = border ? mFullSize : mSize;
     int edge = border ? 0 : mBorder ;
-    TexturePtr texture = TextureManager::getSingleton().createManual(
-                                                                     getUniqueId("Tile"), // Name of texture
-                                                                     "PlanetMap", // Name of resource group in which the texture should be created
-                                                                     TEX_TYPE_2D, // Texture type
-                                                                     size, // Width
-                                                                     size, // Height
-                                                                     1, // Depth (Must be 1 for two dimensional textures)
-                                                                     2, // Number of mipmaps
-                                                                     getPixelFormat(type), // Pixel format
-                                                                     TU_STATIC | TU_AUTOMIPMAP // usage
-                                                                     );
+    TexturePtr texture = createTexture(size, type);
+
     // Blit current front buffer contents into new texture.
     texture->getBuffer()->blit(mTexture->getBuffer(), 
                                Box(edge, edge, 0, size + edge, size + edge, 1),
@@ -132,20 +123,89 @@ Image PlanetMapBuffer::saveImage(bool border, int type) {
     
     // Load data and create an image object.
     mRenderTexture->copyContentsToMemory(pb, RenderTarget::FB_AUTO);
+    Image image = Image().loadDynamicImage(data, mRenderTexture->getWidth(), mRenderTexture->getHeight(), 1, pf, false, 1, 0);
+    return trimBorder(image, border, type);
+}
+
+/**
+ * Start copying the buffer to system memory, without waiting for the GPU.
+ * Returns -1 if the readback has no room, try again later.
+ */
+PlanetReadback::Ticket PlanetMapBuffer::issueImage(PlanetReadback* readback) {
+    return readback->issue(mRenderTexture, getPixelFormat(MAP_TYPE_WORKSPACE));
+}
+
+/**
+ * Fetch an image started with issueImage(), once the readback has it.
+ * Returns an empty image if the readback was lost, issue it again then.
+ */
+Image PlanetMapBuffer::mapImage(PlanetReadback* readback, PlanetReadback::Ticket ticket, bool border, int type) {
+    Image image = readback->map(ticket);
+    if (!image.getData()) return image;
+    return trimBorder(image, border, type);
+}
+
+/**
+ * Turn a workspace readback into a tile image, dropping the border unless asked for.
+ * Heights only keep their first channel, packed as PF_FLOAT16_R: a quarter of the workspace
+ * format, and all PlanetRenderable::analyseTerrain reads.
+ */
+Image PlanetMapBuffer::trimBorder(Image& image, bool border, int type) {
+    if (type == MAP_TYPE_HEIGHT) {
+        assert(image.getFormat() == PF_FLOAT16_RGBA);
+        int edge = border ? 0 : mBorder;
+        int size = image.getWidth() - edge * 2;
+        size_t channels = PixelUtil::getComponentCount(image.getFormat());
+        const uchar* source = image.getData() + edge * image.getRowSpan() + edge * PixelUtil::getNumElemBytes(image.getFormat());
+
+        unsigned short* data = OGRE_ALLOC_T(unsigned short, size * size, MEMCATEGORY_GENERAL);
+        unsigned short* pOut = data;
+        for (int row = 0; row < size; ++row) {
+            const unsigned short* pIn = (const unsigned short*)(source + row * image.getRowSpan());
+            for (int column = 0; column < size; ++column) {
+                *pOut++ = *pIn;
+                pIn += channels;
+            }
+        }
+        OGRE_FREE(image.getData(), MEMCATEGORY_GENERAL);
+        return Image().loadDynamicImage((uchar*)data, size, size, 1, PF_FLOAT16_R, false, 1, 0);
+    }
 
     if (mBorder && !border) {
         // Crop image.
-        Image uncropped = Image().loadDynamicImage(data, mRenderTexture->getWidth(), mRenderTexture->getHeight(), 1, pf, false, 1, 0);
-        Image image = cropImage(uncropped, mBorder, mBorder, mSize, mSize);
-        OGRE_FREE(uncropped.getData(), MEMCATEGORY_GENERAL);
-        return image;
+        Image cropped = cropImage(image, mBorder, mBorder, mSize, mSize);
+        OGRE_FREE(image.getData(), MEMCATEGORY_GENERAL);
+        return cropped;
     }
     else {
         // Return unmodified.
-        return Image().loadDynamicImage(data, mRenderTexture->getWidth(), mRenderTexture->getHeight(), 1, pf, false, 1, 0);
+        return image;
     }
 }
 
+TexturePtr PlanetMapBuffer::loadTexture(const Image& image, int type) {
+    // Upload a map generated in system memory into a new tile texture.
+    assert(image.getWidth() == image.getHeight());
+    TexturePtr texture = createTexture(image.getWidth(), type);
+    texture->getBuffer()->blitFromMemory(image.getPixelBox());
+    return texture;
+}
+
+TexturePtr PlanetMapBuffer::createTexture(int size, int type) {
+    // Alloc write once texture at right size
+    return TextureManager::getSingleton().createManual(
+                                                       getUniqueId("Tile"), // Name of texture
+                                                       "PlanetMap", // Name of resource group in which the texture should be created
+                                                       TEX_TYPE_2D, // Texture type
+                                                       size, // Width
+                                                       size, // Height
+                                                       1, // Depth (Must be 1 for two dimensional textures)
+                                                       2, // Number of mipmaps
+                                                       getPixelFormat(type), // Pixel format
+                                                       TU_STATIC | TU_AUTOMIPMAP // usage
+                                                       );
+}
+
 PixelFormat PlanetMapBuffer::getPixelFormat(int type) {
     switch (type) {
         default:
@@ -12,11 +12,14 @@
 
 #include <Ogre/Ogre.h>
 
+#include "PlanetReadback.h"
+
 using namespace Ogre;
 
 namespace NFSpace {
     
-    typedef unsigned short HeightMapPixel[4];
+    // Height images are a single half float channel (PF_FLOAT16_R), see PlanetMapBuffer::trimBorder.
+    typedef unsigned short HeightMapPixel;
 
     /**
      * Working buffer for creating maps for a planet surface.
@@ -53,6 +56,9 @@ namespace NFSpace {
         void filter(int face, int lod, int x, int y, int type, PlanetMapBuffer* source);
         TexturePtr saveTexture(bool border, int type);
         Image saveImage(bool border, int type);
+        PlanetReadback::Ticket issueImage(PlanetReadback* readback);
+        Image mapImage(PlanetReadback* readback, PlanetReadback::Ticket ticket, bool border, int type);
+        static TexturePtr loadTexture(const Image& image, int type);
 
         void prepareMaterial();
         std::string getMaterial();
@@ -63,7 +69,9 @@ namespace NFSpace {
     protected:
         void init();
         void renderTile(int face, int lod, int x, int y, bool transform, unsigned int clearFrame);
+        Image trimBorder(Image& image, bool border, int type);
         static PixelFormat getPixelFormat(int type);
+        static TexturePtr createTexture(int size, int type);
         
         RenderTexture* mRenderTexture;
     };
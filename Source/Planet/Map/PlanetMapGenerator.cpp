@@ -0,0 +1,236 @@
+/*
+ *  PlanetMapGenerator.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetMapGenerator.h"
+
+#include "Utility.h"
+
+#include "Ogre/OgreBitwise.h"
+
+#include <algorithm>
+
+namespace NFSpace {
+
+const int PlanetMapGenerator::BLOCK_ROWS = 16;
+const Real PlanetMapGenerator::MIN_BRUSH_TEXELS = 2.0f;
+
+PlanetMapGenerator::PlanetMapGenerator(int size, int border, Real fill)
+: mSize(size), mBorder(border), mFill(fill), mBaseMap(0), mScript(0), mRasterizer(size, border, fill), mNormalMapper(size, border) {
+    mFullSize = mSize + 2 * mBorder;
+}
+
+PlanetMapGenerator::~PlanetMapGenerator() {
+}
+
+void PlanetMapGenerator::setBaseMap(const PlanetBaseMap* baseMap) {
+    mBaseMap = baseMap;
+}
+
+void PlanetMapGenerator::setScript(const PlanetTerrainScript* script) {
+    mScript = script;
+}
+
+/**
+ * Number of floats needed in the workspace passed to generate().
+ */
+int PlanetMapGenerator::getWorkspaceSize() const {
+    // Heights incl. border, plus one block of normals.
+    int size = mFullSize * mFullSize + BLOCK_ROWS * mSize;
+    if (mScript) {
+        // One block of texel positions and script registers.
+        size += BLOCK_ROWS * mFullSize * (3 + mScript->getRegisterCount());
+    }
+    return size;
+}
+
+/**
+ * Build a tile. With a parent image, brushes only holds the residual brushes to draw on top
+ * of it, and edgeBrushes those for texels past the parent's edge (see selectBrushes).
+ */
+void PlanetMapGenerator::generate(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                                  float* workspace, Image& heightImage, Image& normalImage,
+                                  const Image* parentImage, const PlanetBrushTable::BrushSet* edgeBrushes) const {
+    float* heights = workspace;
+    float* normals = workspace + mFullSize * mFullSize;
+    float* positions = normals + BLOCK_ROWS * mSize;
+    float* registers = positions + BLOCK_ROWS * mFullSize * 3;
+
+    bool brushLayer = !mScript || mScript->usesBrushes();
+    Real fill = mScript ? 0.0f : mFill;
+
+    heightImage = mRasterizer.allocImage();
+    normalImage = mNormalMapper.allocImage();
+
+    Upsample upsample;
+    if (parentImage) {
+        assert(edgeBrushes);
+        prepareUpsample(lod, x, y, upsample);
+    }
+
+    int rendered = 0, heightRows = 0, normalRows = 0;
+    while (rendered < mFullSize) {
+        // Rasterize the next block of workspace rows.
+        int end = mini(rendered + BLOCK_ROWS, mFullSize);
+        float* block = heights + rendered * mFullSize;
+        int count = (end - rendered) * mFullSize;
+        if (brushLayer) {
+            if (parentImage) {
+                upsampleRows(*parentImage, upsample, heights, rendered, end);
+            }
+            else if (mBaseMap) {
+                mBaseMap->sampleRows(mRasterizer, face, lod, x, y, fill, heights, rendered, end);
+            }
+            else if (mScript) {
+                std::fill(block, block + count, 0.0f);
+            }
+            mRasterizer.renderRows(face, lod, x, y, table, brushes, heights, rendered, end, parentImage || mBaseMap || mScript);
+            if (parentImage) {
+                renderEdges(face, lod, x, y, table, *edgeBrushes, upsample, heights, rendered, end);
+            }
+        }
+        if (mScript) {
+            // Run the terrain program over the block, in place.
+            mRasterizer.getRowPositions(face, lod, x, y, rendered, end, positions, positions + count, positions + count * 2);
+            mScript->evaluate(block, positions, positions + count, positions + count * 2, registers, block, count, mFill);
+        }
+        rendered = end;
+
+        // Emit finished height rows.
+        int heightEnd = mini(mSize, rendered - mBorder);
+        if (heightEnd > heightRows) {
+            mRasterizer.saveRows(heights, heightImage, heightRows, heightEnd);
+            heightRows = heightEnd;
+        }
+
+        // Emit normal rows once the rows below them are in.
+        int normalEnd = mini(mSize, rendered - mBorder - 1);
+        if (normalEnd > normalRows) {
+            mNormalMapper.filterRows(face, lod, x, y, heights, normals, normalRows, normalEnd);
+            mNormalMapper.saveRows(normals, normalImage, normalRows, normalEnd);
+            normalRows = normalEnd;
+        }
+    }
+}
+
+/**
+ * Keep only the brushes that matter at this level. In upsampling mode, a brush is drawn
+ * from the first level at which it spans MIN_BRUSH_TEXELS texels: into that level's tiles
+ * from scratch, or as a residual on top of an upsampled parent that didn't resolve it yet.
+ */
+void PlanetMapGenerator::selectBrushes(const PlanetBrushTable& table, int lod, bool upsampled, PlanetBrushTable::BrushSet& brushes) const {
+    // Texels per unit of face space at this level.
+    Real density = Real(1 << lod) * (mSize - 1) * 0.5f;
+
+    PlanetBrushTable::BrushSet::iterator out = brushes.begin();
+    for (PlanetBrushTable::BrushSet::iterator it = brushes.begin(); it != brushes.end(); ++it) {
+        const Vector2& scale = table.mScale[*it];
+        Real texels = maxf(scale.x, scale.y) * 2.0f * density;
+        if (texels < MIN_BRUSH_TEXELS) continue;
+        if (upsampled && texels * 0.5f >= MIN_BRUSH_TEXELS) continue;
+        *out++ = *it;
+    }
+    brushes.erase(out, brushes.end());
+}
+
+/**
+ * Map every child workspace column and row to the parent's image (no border), via face space.
+ */
+void PlanetMapGenerator::prepareUpsample(int lod, int x, int y, Upsample& upsample) const {
+    assert(lod > 0);
+    int parentLOD = lod - 1, parentX = x / 2, parentY = y / 2;
+
+    Real faceX0, faceY0, faceX1, faceY1, faceX, faceY;
+    mRasterizer.getTexelFace(parentLOD, parentX, parentY, 0, 0, faceX0, faceY0);
+    mRasterizer.getTexelFace(parentLOD, parentX, parentY, 1, 1, faceX1, faceY1);
+
+    upsample.mColumns.resize(mFullSize);
+    upsample.mColumnWeights.resize(mFullSize);
+    upsample.mRows.resize(mFullSize);
+    upsample.mRowWeights.resize(mFullSize);
+    upsample.mLeft = upsample.mTop = mFullSize;
+    upsample.mRight = upsample.mBottom = 0;
+
+    // Border dilation leaves the grids slightly misaligned: a few thousandths of a texel
+    // past the edge still counts as inside, the half texel of the child's border doesn't.
+    const Real epsilon = 0.25f;
+    for (int i = 0; i < mFullSize; ++i) {
+        mRasterizer.getTexelFace(lod, x, y, i, i, faceX, faceY);
+        Real column = (faceX - faceX0) / (faceX1 - faceX0) - mBorder;
+        Real row = (faceY - faceY0) / (faceY1 - faceY0) - mBorder;
+
+        if (column > -epsilon && column < mSize - 1 + epsilon) {
+            upsample.mLeft = mini(upsample.mLeft, i);
+            upsample.mRight = maxi(upsample.mRight, i + 1);
+        }
+        if (row > -epsilon && row < mSize - 1 + epsilon) {
+            upsample.mTop = mini(upsample.mTop, i);
+            upsample.mBottom = maxi(upsample.mBottom, i + 1);
+        }
+
+        // Clamped, texels past the edge are rendered over by renderEdges().
+        column = maxf(0, minf(mSize - 1, column));
+        row = maxf(0, minf(mSize - 1, row));
+        upsample.mColumns[i] = mini((int)column, mSize - 2);
+        upsample.mColumnWeights[i] = column - upsample.mColumns[i];
+        upsample.mRows[i] = mini((int)row, mSize - 2);
+        upsample.mRowWeights[i] = row - upsample.mRows[i];
+    }
+}
+
+/**
+ * Fill workspace rows [begin, end) with the parent tile's heights, bilinearly interpolated.
+ */
+void PlanetMapGenerator::upsampleRows(const Image& parentImage, const Upsample& upsample, float* heights, int begin, int end) const {
+    assert((int)parentImage.getWidth() == mSize && (int)parentImage.getHeight() == mSize);
+    const unsigned short* parent = (const unsigned short*)parentImage.getData();
+
+    for (int row = begin; row < end; ++row) {
+        Real rowWeight = upsample.mRowWeights[row];
+        const unsigned short* top = parent + upsample.mRows[row] * mSize;
+        const unsigned short* bottom = top + mSize;
+        float* pOut = heights + row * mFullSize;
+        for (int column = 0; column < mFullSize; ++column) {
+            int left = upsample.mColumns[column], right = left + 1;
+            Real weight = upsample.mColumnWeights[column];
+
+            Real upper = Bitwise::halfToFloat(top[left]) * (1 - weight) + Bitwise::halfToFloat(top[right]) * weight;
+            Real lower = Bitwise::halfToFloat(bottom[left]) * (1 - weight) + Bitwise::halfToFloat(bottom[right]) * weight;
+            *pOut++ = upper * (1 - rowWeight) + lower * rowWeight;
+        }
+    }
+}
+
+/**
+ * Render the texels of rows [begin, end) that lie past the parent's edge from scratch, over
+ * whatever was upsampled there.
+ */
+void PlanetMapGenerator::renderEdges(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                                     const Upsample& upsample, float* heights, int begin, int end) const {
+    // Whole rows above and below the parent.
+    renderRect(face, lod, x, y, table, brushes, heights, 0, begin, mFullSize, mini(end, upsample.mTop));
+    renderRect(face, lod, x, y, table, brushes, heights, 0, maxi(begin, upsample.mBottom), mFullSize, end);
+
+    // Columns left and right of it, in between.
+    int top = maxi(begin, upsample.mTop), bottom = mini(end, upsample.mBottom);
+    renderRect(face, lod, x, y, table, brushes, heights, 0, top, upsample.mLeft, bottom);
+    renderRect(face, lod, x, y, table, brushes, heights, upsample.mRight, top, mFullSize, bottom);
+}
+
+/**
+ * Render texels the way a tile without a parent does: base map or fill, plus brushes.
+ */
+void PlanetMapGenerator::renderRect(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                                    float* heights, int left, int top, int right, int bottom) const {
+    if (left >= right || top >= bottom) return;
+    if (mBaseMap) {
+        mBaseMap->sampleRect(mRasterizer, face, lod, x, y, mFill, heights, left, top, right, bottom);
+    }
+    mRasterizer.renderRect(face, lod, x, y, table, brushes, heights, left, top, right, bottom, mBaseMap != 0);
+}
+
+};
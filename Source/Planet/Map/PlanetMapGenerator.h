@@ -0,0 +1,96 @@
+/*
+ *  PlanetMapGenerator.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetMapGenerator_H
+#define PlanetMapGenerator_H
+
+#include <Ogre/Ogre.h>
+
+#include "PlanetBaseMap.h"
+#include "PlanetBrushTable.h"
+#include "PlanetMapRasterizer.h"
+#include "PlanetNormalMapper.h"
+#include "PlanetTerrainScript.h"
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Builds complete map tiles (height and normal image) on the CPU.
+     *
+     * Height and normals are produced in one sweep over the tile, a block of rows at a time.
+     * Each block is rasterized, converted, and filtered as soon as the rows around it are
+     * done, so the normal filter reads heights that are still in cache.
+     *
+     * A child tile can also be seeded from its parent's height image. The parent's quadrant
+     * is upsampled, and only brushes that were too small to show up at the parent's
+     * resolution are rasterized on top (see selectBrushes). Border texels past the parent's
+     * edge are rendered from scratch instead, so the normals along it see real heights.
+     *
+     * Tiles without a parent start from the planet's base map instead, if one is set.
+     *
+     * With a terrain script set, the brush layer (if the script uses it) is built the same
+     * way relative to zero, and every block is then run through the script's program.
+     *
+     * Safe to call from several threads at once, as long as each uses its own workspace.
+     */
+    class PlanetMapGenerator {
+    public:
+        static const int BLOCK_ROWS;
+        static const Real MIN_BRUSH_TEXELS;
+
+        PlanetMapGenerator(int size, int border, Real fill);
+        ~PlanetMapGenerator();
+
+        void generate(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                      float* workspace, Image& heightImage, Image& normalImage,
+                      const Image* parentImage, const PlanetBrushTable::BrushSet* edgeBrushes) const;
+        void selectBrushes(const PlanetBrushTable& table, int lod, bool upsampled, PlanetBrushTable::BrushSet& brushes) const;
+
+        void setBaseMap(const PlanetBaseMap* baseMap);
+        void setScript(const PlanetTerrainScript* script);
+        int getWorkspaceSize() const;
+
+    protected:
+        /**
+         * Where a child tile's workspace texels fall in its parent's height image. Texels
+         * outside columns [mLeft, mRight) or rows [mTop, mBottom) lie past the parent's edge.
+         */
+        struct Upsample {
+            std::vector<int> mColumns;
+            std::vector<Real> mColumnWeights;
+            std::vector<int> mRows;
+            std::vector<Real> mRowWeights;
+            int mLeft;
+            int mTop;
+            int mRight;
+            int mBottom;
+        };
+
+        void prepareUpsample(int lod, int x, int y, Upsample& upsample) const;
+        void upsampleRows(const Image& parentImage, const Upsample& upsample, float* heights, int begin, int end) const;
+        void renderEdges(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                         const Upsample& upsample, float* heights, int begin, int end) const;
+        void renderRect(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes,
+                        float* heights, int left, int top, int right, int bottom) const;
+
+        int mSize;
+        int mBorder;
+        int mFullSize;
+        Real mFill;
+
+        const PlanetBaseMap* mBaseMap;
+        const PlanetTerrainScript* mScript;
+        PlanetMapRasterizer mRasterizer;
+        PlanetNormalMapper mNormalMapper;
+    };
+
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ *  PlanetMapRasterizer.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetMapRasterizer.h"
+#include "PlanetCube.h"
+
+#include "Utility.h"
+
+#include "Ogre/OgreBitwise.h"
+
+namespace NFSpace {
+
+PlanetMapRasterizer::PlanetMapRasterizer(int size, int border, Real fill)
+: mSize(size), mBorder(border), mFill(fill), mBrushMap(0), mNoiseMap(0), mOwnsMaps(true) {
+    assert(isPowerOf2(size - 1));
+    mFullSize = mSize + 2 * mBorder;
+    loadMaps();
+}
+
+/**
+ * Rasterizer of another size that borrows the brush and noise maps of an existing one,
+ * instead of loading its own. The owner must outlive it.
+ */
+PlanetMapRasterizer::PlanetMapRasterizer(const PlanetMapRasterizer& maps, int size, int border, Real fill)
+: mSize(size), mBorder(border), mFill(fill),
+  mBrushMapWidth(maps.mBrushMapWidth), mBrushMapHeight(maps.mBrushMapHeight), mBrushMap(maps.mBrushMap),
+  mNoiseMapWidth(maps.mNoiseMapWidth), mNoiseMapHeight(maps.mNoiseMapHeight), mNoiseMap(maps.mNoiseMap),
+  mOwnsMaps(false) {
+    assert(isPowerOf2(size - 1));
+    mFullSize = mSize + 2 * mBorder;
+}
+
+PlanetMapRasterizer::~PlanetMapRasterizer() {
+    if (mOwnsMaps) {
+        OGRE_FREE(mBrushMap, MEMCATEGORY_GENERAL);
+        OGRE_FREE(mNoiseMap, MEMCATEGORY_GENERAL);
+    }
+}
+
+int PlanetMapRasterizer::getFullSize() const {
+    return mFullSize;
+}
+
+void PlanetMapRasterizer::loadMaps() {
+    // Same textures as used by the Planet/BrushCarverNoisy material.
+    Image brushMap, noiseMap;
+    brushMap.load("dent.png", ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    noiseMap.load("noise-32-32.png", ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+
+    // Convert to float so lookups match the GPU's normalized texture reads.
+    mBrushMapWidth = brushMap.getWidth();
+    mBrushMapHeight = brushMap.getHeight();
+    mBrushMap = OGRE_ALLOC_T(float, mBrushMapWidth * mBrushMapHeight, MEMCATEGORY_GENERAL);
+    PixelUtil::bulkPixelConversion(brushMap.getPixelBox(),
+                                   PixelBox(mBrushMapWidth, mBrushMapHeight, 1, PF_FLOAT32_R, mBrushMap));
+
+    // Keep only the R and G channels of the noise map, interleaved.
+    mNoiseMapWidth = noiseMap.getWidth();
+    mNoiseMapHeight = noiseMap.getHeight();
+    float* noiseRGB = OGRE_ALLOC_T(float, mNoiseMapWidth * mNoiseMapHeight * 3, MEMCATEGORY_GENERAL);
+    PixelUtil::bulkPixelConversion(noiseMap.getPixelBox(),
+                                   PixelBox(mNoiseMapWidth, mNoiseMapHeight, 1, PF_FLOAT32_RGB, noiseRGB));
+
+    mNoiseMap = OGRE_ALLOC_T(float, mNoiseMapWidth * mNoiseMapHeight * 2, MEMCATEGORY_GENERAL);
+    for (int i = 0; i < mNoiseMapWidth * mNoiseMapHeight; ++i) {
+        mNoiseMap[i * 2]     = noiseRGB[i * 3];
+        mNoiseMap[i * 2 + 1] = noiseRGB[i * 3 + 1];
+    }
+    OGRE_FREE(noiseRGB, MEMCATEGORY_GENERAL);
+}
+
+/**
+ * Inverse of the projection set up in PlanetMapBuffer::renderTile: maps a workspace texel
+ * center back to normalized device coordinates of the whole cube face.
+ */
+void PlanetMapRasterizer::getTexelFace(int lod, int x, int y, Real column, Real row, Real& faceX, Real& faceY) const {
+    // Texel center in viewport space. Rows run top-down.
+    Real ndcX = (2.0f * column + 1.0f) / mFullSize - 1.0f;
+    Real ndcY = 1.0f - (2.0f * row + 1.0f) / mFullSize;
+
+    // Undo border dilation.
+    Real dilation = mSize / float(mFullSize + 1);
+    ndcX /= dilation;
+    ndcY /= dilation;
+
+    // Undo tile skew.
+    int scale = 1 << lod;
+    faceX = (ndcX - (scale - x * 2 - 1)) / scale;
+    faceY = (ndcY - (scale - (scale - y - 1) * 2 - 1)) / scale;
+}
+
+/**
+ * Maps a workspace texel center back to a (non-normalized) view ray in planet space.
+ */
+void PlanetMapRasterizer::getTexelDirection(const Quaternion& orientation, int lod, int x, int y, int column, int row, Vector3& direction) const {
+    Real faceX, faceY;
+    getTexelFace(lod, x, y, column, row, faceX, faceY);
+
+    // 90 degree FOV camera looking down -Z.
+    direction = orientation * Vector3(faceX, faceY, -1.0f);
+}
+
+Real PlanetMapRasterizer::sampleBrushMap(Real u, Real v) const {
+    // Bilinear, clamped to edge.
+    Real fx = u * mBrushMapWidth - 0.5f;
+    Real fy = v * mBrushMapHeight - 0.5f;
+    int x0 = (int)floorf(fx), y0 = (int)floorf(fy);
+    Real ax = fx - x0, ay = fy - y0;
+
+    int x1 = mini(maxi(x0 + 1, 0), mBrushMapWidth - 1);
+    int y1 = mini(maxi(y0 + 1, 0), mBrushMapHeight - 1);
+    x0 = mini(maxi(x0, 0), mBrushMapWidth - 1);
+    y0 = mini(maxi(y0, 0), mBrushMapHeight - 1);
+
+    const float* row0 = mBrushMap + y0 * mBrushMapWidth;
+    const float* row1 = mBrushMap + y1 * mBrushMapWidth;
+    Real top    = row0[x0] + (row0[x1] - row0[x0]) * ax;
+    Real bottom = row1[x0] + (row1[x1] - row1[x0]) * ax;
+    return top + (bottom - top) * ay;
+}
+
+void PlanetMapRasterizer::sampleNoiseMap(Real u, Real v, Real& r, Real& g) const {
+    // Bilinear, wrapped.
+    Real fx = u * mNoiseMapWidth - 0.5f;
+    Real fy = v * mNoiseMapHeight - 0.5f;
+    Real flx = floorf(fx), fly = floorf(fy);
+    Real ax = fx - flx, ay = fy - fly;
+
+    int x0 = (int)flx % mNoiseMapWidth, y0 = (int)fly % mNoiseMapHeight;
+    if (x0 < 0) x0 += mNoiseMapWidth;
+    if (y0 < 0) y0 += mNoiseMapHeight;
+    int x1 = (x0 + 1) % mNoiseMapWidth, y1 = (y0 + 1) % mNoiseMapHeight;
+
+    const float* p00 = mNoiseMap + (y0 * mNoiseMapWidth + x0) * 2;
+    const float* p10 = mNoiseMap + (y0 * mNoiseMapWidth + x1) * 2;
+    const float* p01 = mNoiseMap + (y1 * mNoiseMapWidth + x0) * 2;
+    const float* p11 = mNoiseMap + (y1 * mNoiseMapWidth + x1) * 2;
+
+    Real top, bottom;
+    top    = p00[0] + (p10[0] - p00[0]) * ax;
+    bottom = p01[0] + (p11[0] - p01[0]) * ax;
+    r = top + (bottom - top) * ay;
+    top    = p00[1] + (p10[1] - p00[1]) * ax;
+    bottom = p01[1] + (p11[1] - p01[1]) * ax;
+    g = top + (bottom - top) * ay;
+}
+
+/**
+ * Port of brushCarverBatched_FP.
+ */
+Real PlanetMapRasterizer::evaluateBrush(const PlanetBrushTable& table, int brush, Real u, Real v) const {
+    const Vector2& noiseOffset = table.mNoiseOffset[brush];
+    Real noiseIntensity = table.mNoiseIntensity[brush];
+
+    Real noiseR = 0, noiseG = 0, r, g;
+    Real scale = table.mNoiseScale[brush], weight = 1.0f;
+    for (int octave = 0; octave < 7; ++octave) {
+        sampleNoiseMap(u * scale + noiseOffset.x, v * scale + noiseOffset.y, r, g);
+        noiseR += r * weight;
+        noiseG += g * weight;
+        scale *= 2.0f;
+        weight *= 0.5f;
+    }
+
+    Real falloff = 16.0f * u * (1.0f - u) * v * (1.0f - v);
+    Real uAdjusted = u + falloff * (noiseR * 2.0f - 1.0f) * noiseIntensity;
+    Real vAdjusted = v + falloff * (noiseG * 2.0f - 1.0f) * noiseIntensity;
+
+    return (sampleBrushMap(uAdjusted, vAdjusted) - 0.5f) * table.mCarveIntensity[brush];
+}
+
+/**
+ * Unit sphere position of every texel in workspace rows [begin, end), one array per axis.
+ */
+void PlanetMapRasterizer::getRowPositions(int face, int lod, int x, int y, int begin, int end, float* positionX, float* positionY, float* positionZ) const {
+    Quaternion orientation = PlanetCube::getFaceCamera(face);
+    orientation.normalise();
+
+    Vector3 direction;
+    for (int row = begin; row < end; ++row) {
+        for (int column = 0; column < mFullSize; ++column) {
+            getTexelDirection(orientation, lod, x, y, column, row, direction);
+            direction.normalise();
+            *positionX++ = direction.x;
+            *positionY++ = direction.y;
+            *positionZ++ = direction.z;
+        }
+    }
+}
+
+void PlanetMapRasterizer::render(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace) const {
+    renderRows(face, lod, x, y, table, brushes, workspace, 0, mFullSize, false);
+}
+
+/**
+ * Render workspace rows [begin, end), including border rows. When accumulating, brushes
+ * are added on top of the existing workspace contents instead of the fill value.
+ */
+void PlanetMapRasterizer::renderRows(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace, int begin, int end, bool accumulate) const {
+    renderRect(face, lod, x, y, table, brushes, workspace, 0, begin, mFullSize, end, accumulate);
+}
+
+/**
+ * Render the workspace texels in columns [left, right) of rows [top, bottom).
+ */
+void PlanetMapRasterizer::renderRect(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace,
+                                     int left, int top, int right, int bottom, bool accumulate) const {
+    Quaternion orientation = PlanetCube::getFaceCamera(face);
+    orientation.normalise();
+
+    Vector3 direction;
+    for (int row = top; row < bottom; ++row) {
+        float* pOut = workspace + row * mFullSize + left;
+        for (int column = left; column < right; ++column) {
+            getTexelDirection(orientation, lod, x, y, column, row, direction);
+
+            // Clear color, then additive blending of every brush quad covering this texel.
+            Real height = accumulate ? *pOut : mFill;
+            for (PlanetBrushTable::BrushSet::const_iterator it = brushes.begin(); it != brushes.end(); ++it) {
+                int brush = *it;
+                const Vector3& position = table.mPosition[brush];
+
+                // Intersect view ray with the brush's tangent plane.
+                Real distance = direction.dotProduct(position);
+                if (distance <= 0) continue;
+                Vector3 offset = direction / distance - position;
+
+                Real u = offset.dotProduct(table.mRight[brush]) / table.mScale[brush].x;
+                if (u < -1.0f || u > 1.0f) continue;
+                Real v = offset.dotProduct(table.mFront[brush]) / table.mScale[brush].y;
+                if (v < -1.0f || v > 1.0f) continue;
+
+                height += evaluateBrush(table, brush, (u + 1.0f) * 0.5f, (v + 1.0f) * 0.5f);
+            }
+            *pOut++ = height;
+        }
+    }
+}
+
+Image PlanetMapRasterizer::allocImage() const {
+    PixelFormat pf = PF_FLOAT16_R;
+    uchar* data = OGRE_ALLOC_T(uchar, mSize * mSize * PixelUtil::getNumElemBytes(pf), MEMCATEGORY_GENERAL);
+    return Image().loadDynamicImage(data, mSize, mSize, 1, pf, false, 1, 0);
+}
+
+/**
+ * Convert rows [begin, end) of the tile without its border into an image from allocImage().
+ */
+void PlanetMapRasterizer::saveRows(const float* workspace, Image& image, int begin, int end) const {
+    writeRows(workspace + mBorder * mFullSize + mBorder, (unsigned short*)image.getData(), mSize, begin, end);
+}
+
+void PlanetMapRasterizer::writeRows(const float* workspace, unsigned short* data, int size, int begin, int end) const {
+    for (int row = begin; row < end; ++row) {
+        const float* pIn = workspace + row * mFullSize;
+        unsigned short* pOut = data + row * size;
+        for (int column = 0; column < size; ++column) {
+            *pOut++ = Bitwise::floatToHalf(*pIn++);
+        }
+    }
+}
+
+};
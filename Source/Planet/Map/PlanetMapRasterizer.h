@@ -0,0 +1,77 @@
+/*
+ *  PlanetMapRasterizer.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetMapRasterizer_H
+#define PlanetMapRasterizer_H
+
+#include <Ogre/Ogre.h>
+
+#include "PlanetBrushTable.h"
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * CPU reference implementation of PlanetMapBuffer::render.
+     *
+     * Traces every texel of a tile (including its border) through the same face camera,
+     * tile skew and border dilation as the GPU render pass, and evaluates the
+     * brushCarverBatched_FP program for every brush quad it hits.
+     *
+     * The workspace is a row-major array of fullSize x fullSize floats, stored top row first
+     * (like the flipped GL render target).
+     *
+     * render() and saveRows() only read shared state and may be called from worker threads.
+     */
+    class PlanetMapRasterizer {
+    public:
+        PlanetMapRasterizer(int size, int border, Real fill);
+        PlanetMapRasterizer(const PlanetMapRasterizer& maps, int size, int border, Real fill);
+        ~PlanetMapRasterizer();
+
+        void render(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace) const;
+        void renderRows(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace, int begin, int end, bool accumulate) const;
+        void renderRect(int face, int lod, int x, int y, const PlanetBrushTable& table, const PlanetBrushTable::BrushSet& brushes, float* workspace,
+                        int left, int top, int right, int bottom, bool accumulate) const;
+
+        Image allocImage() const;
+        void saveRows(const float* workspace, Image& image, int begin, int end) const;
+
+        int getFullSize() const;
+        void getTexelFace(int lod, int x, int y, Real column, Real row, Real& faceX, Real& faceY) const;
+        void getRowPositions(int face, int lod, int x, int y, int begin, int end, float* positionX, float* positionY, float* positionZ) const;
+
+    protected:
+        void loadMaps();
+        void getTexelDirection(const Quaternion& orientation, int lod, int x, int y, int column, int row, Vector3& direction) const;
+
+        Real sampleBrushMap(Real u, Real v) const;
+        void sampleNoiseMap(Real u, Real v, Real& r, Real& g) const;
+        Real evaluateBrush(const PlanetBrushTable& table, int brush, Real u, Real v) const;
+        void writeRows(const float* workspace, unsigned short* data, int size, int begin, int end) const;
+
+        int mSize;
+        int mBorder;
+        int mFullSize;
+        Real mFill;
+
+        int mBrushMapWidth;
+        int mBrushMapHeight;
+        float* mBrushMap;
+
+        int mNoiseMapWidth;
+        int mNoiseMapHeight;
+        float* mNoiseMap;
+
+        bool mOwnsMaps;
+    };
+
+};
+
+#endif
@@ -12,22 +12,35 @@
 
 namespace NFSpace {
     
-    PlanetMapTile::PlanetMapTile(QuadTreeNode* node, TexturePtr heightTexture, Image heightImage, TexturePtr normalTexture, int size) {
+    PlanetMapTile::PlanetMapTile(QuadTreeNode* node, TexturePtr heightTexture, Image heightImage, TexturePtr normalTexture, int size, bool ownHeightImage) {
         mNode = node;
         
         mHeightTexture = heightTexture;
         mHeightImage   = heightImage;
+        // Height images from a tile pack are mapped read-only, and not ours to free.
+        mOwnHeightImage = ownHeightImage;
         mNormalTexture = normalTexture;
         mSize = size;
         mReferences = 0;
-        
+
+        // Mip chains add a third to the base level.
+        mGPUMemoryUsage = 1.3125 * (
+            mHeightTexture->getWidth() * mHeightTexture->getHeight() * PixelUtil::getNumElemBytes(mHeightTexture->getFormat()) +
+            mNormalTexture->getWidth() * mNormalTexture->getHeight() * PixelUtil::getNumElemBytes(mNormalTexture->getFormat()));
+        // Mapped height images live in the page cache, not on our heap.
+        mCPUMemoryUsage = mOwnHeightImage ? mHeightImage.getSize() : 0;
+
         PlanetStats::totalTiles++;
+        PlanetStats::gpuMemoryUsage += mGPUMemoryUsage;
+        PlanetStats::cpuMemoryUsage += mCPUMemoryUsage;
 
         prepareMaterial();
     }
     
     PlanetMapTile::~PlanetMapTile() {
-        OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+        if (mOwnHeightImage) {
+            OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+        }
 
         if (mMaterialCreated) {
             MaterialManager::getSingleton().remove(mMaterial->getName());
@@ -36,6 +49,8 @@ namespace NFSpace {
         TextureManager::getSingleton().remove(mNormalTexture->getName());
 
         PlanetStats::totalTiles--;
+        PlanetStats::gpuMemoryUsage -= mGPUMemoryUsage;
+        PlanetStats::cpuMemoryUsage -= mCPUMemoryUsage;
     }
 
     String PlanetMapTile::getMaterial() {
@@ -70,9 +85,11 @@ namespace NFSpace {
     }
     
     size_t PlanetMapTile::getGPUMemoryUsage() {
-        return 1.3125 * (
-            mHeightTexture->getWidth() * mHeightTexture->getHeight() * Ogre::PixelUtil::getNumElemBytes(mHeightTexture->getFormat()) +
-            mNormalTexture->getWidth() * mNormalTexture->getHeight() * Ogre::PixelUtil::getNumElemBytes(mNormalTexture->getFormat()));
+        return mGPUMemoryUsage;
+    }
+
+    size_t PlanetMapTile::getCPUMemoryUsage() {
+        return mCPUMemoryUsage;
     }
 
     void PlanetMapTile::addReference() {
@@ -19,12 +19,13 @@ namespace NFSpace {
     
 class PlanetMapTile {
 public:
-    PlanetMapTile(QuadTreeNode* node, TexturePtr heightTexture, Image heightImage, TexturePtr normalTexture, int size);
+    PlanetMapTile(QuadTreeNode* node, TexturePtr heightTexture, Image heightImage, TexturePtr normalTexture, int size, bool ownHeightImage = true);
     ~PlanetMapTile();
     String getMaterial();    
     Image* getHeightMap();
     const QuadTreeNode* getNode();
     size_t getGPUMemoryUsage();
+    size_t getCPUMemoryUsage();
     void addReference();
     void removeReference();
     int getReferences();
@@ -37,10 +38,14 @@ protected:
     QuadTreeNode* mNode;
     TexturePtr mHeightTexture;
     Image mHeightImage;
+    bool mOwnHeightImage;
     TexturePtr mNormalTexture;
     MaterialPtr mMaterial;
     int mSize;
     int mReferences;
+    // Fixed for the tile's lifetime, and counted into PlanetStats while it exists.
+    size_t mGPUMemoryUsage;
+    size_t mCPUMemoryUsage;
 };
 
 }
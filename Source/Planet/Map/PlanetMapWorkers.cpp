@@ -0,0 +1,219 @@
+/*
+ *  PlanetMapWorkers.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetMapWorkers.h"
+
+#include "Utility.h"
+
+#include <assert.h>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace NFSpace {
+
+/**
+ * Mutex, the two conditions (work queued, all work done) and the threads.
+ */
+struct PlanetMapWorkers::Sync {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+    CRITICAL_SECTION mMutex;
+    CONDITION_VARIABLE mCondition;
+    CONDITION_VARIABLE mIdle;
+    std::vector<HANDLE> mThreads;
+
+    Sync() {
+        InitializeCriticalSection(&mMutex);
+        InitializeConditionVariable(&mCondition);
+        InitializeConditionVariable(&mIdle);
+    }
+    ~Sync() {
+        DeleteCriticalSection(&mMutex);
+    }
+
+    void lock() { EnterCriticalSection(&mMutex); }
+    void unlock() { LeaveCriticalSection(&mMutex); }
+    void wait(CONDITION_VARIABLE& condition) { SleepConditionVariableCS(&condition, &mMutex, INFINITE); }
+    void signal(CONDITION_VARIABLE& condition) { WakeConditionVariable(&condition); }
+    void broadcast(CONDITION_VARIABLE& condition) { WakeAllConditionVariable(&condition); }
+
+    static unsigned __stdcall threadMain(void* workers) {
+        static_cast<PlanetMapWorkers*>(workers)->work();
+        return 0;
+    }
+    bool start(PlanetMapWorkers* workers) {
+        HANDLE thread = (HANDLE)_beginthreadex(0, 0, &Sync::threadMain, workers, 0, 0);
+        if (!thread) return false;
+        mThreads.push_back(thread);
+        return true;
+    }
+    void join() {
+        for (size_t i = 0; i < mThreads.size(); ++i) {
+            WaitForSingleObject(mThreads[i], INFINITE);
+            CloseHandle(mThreads[i]);
+        }
+        mThreads.clear();
+    }
+#else
+    pthread_mutex_t mMutex;
+    pthread_cond_t mCondition;
+    pthread_cond_t mIdle;
+    std::vector<pthread_t> mThreads;
+
+    Sync() {
+        pthread_mutex_init(&mMutex, 0);
+        pthread_cond_init(&mCondition, 0);
+        pthread_cond_init(&mIdle, 0);
+    }
+    ~Sync() {
+        pthread_cond_destroy(&mCondition);
+        pthread_cond_destroy(&mIdle);
+        pthread_mutex_destroy(&mMutex);
+    }
+
+    void lock() { pthread_mutex_lock(&mMutex); }
+    void unlock() { pthread_mutex_unlock(&mMutex); }
+    void wait(pthread_cond_t& condition) { pthread_cond_wait(&condition, &mMutex); }
+    void signal(pthread_cond_t& condition) { pthread_cond_signal(&condition); }
+    void broadcast(pthread_cond_t& condition) { pthread_cond_broadcast(&condition); }
+
+    static void* threadMain(void* workers) {
+        static_cast<PlanetMapWorkers*>(workers)->work();
+        return 0;
+    }
+    bool start(PlanetMapWorkers* workers) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, &Sync::threadMain, workers) != 0) return false;
+        mThreads.push_back(thread);
+        return true;
+    }
+    void join() {
+        for (size_t i = 0; i < mThreads.size(); ++i) {
+            pthread_join(mThreads[i], 0);
+        }
+        mThreads.clear();
+    }
+#endif
+};
+
+PlanetMapWorkers::PlanetMapWorkers(int threads)
+: mThreadCount(0), mSync(new Sync), mPending(0), mExit(false) {
+    assert(threads > 0);
+
+    for (int i = 0; i < threads; ++i) {
+        if (!mSync->start(this)) {
+            log("PlanetMapWorkers: could not start worker thread.");
+            break;
+        }
+        mThreadCount++;
+    }
+}
+
+PlanetMapWorkers::~PlanetMapWorkers() {
+    // Wake up all workers and wait for them to finish their current job.
+    mSync->lock();
+    mExit = true;
+    mSync->broadcast(mSync->mCondition);
+    mSync->unlock();
+    mSync->join();
+
+    // Discard unclaimed work.
+    for (JobList::iterator it = mQueue.begin(); it != mQueue.end(); ++it) {
+        delete *it;
+    }
+    for (JobList::iterator it = mFinished.begin(); it != mFinished.end(); ++it) {
+        delete *it;
+    }
+
+    delete mSync;
+}
+
+void PlanetMapWorkers::submit(Job* job) {
+    if (!mThreadCount) {
+        // No workers, run it here.
+        run(job);
+        mSync->lock();
+        mFinished.push_back(job);
+        mSync->unlock();
+        return;
+    }
+
+    mSync->lock();
+    mQueue.push_back(job);
+    mPending++;
+    mSync->signal(mSync->mCondition);
+    mSync->unlock();
+}
+
+void PlanetMapWorkers::collect(JobList& finished) {
+    mSync->lock();
+    finished.splice(finished.end(), mFinished);
+    mSync->unlock();
+}
+
+/**
+ * Block until all submitted jobs have run.
+ */
+void PlanetMapWorkers::finish() {
+    mSync->lock();
+    while (mPending > 0) {
+        mSync->wait(mSync->mIdle);
+    }
+    mSync->unlock();
+}
+
+/**
+ * Jobs that can run at once: the threads started, or 1 if jobs run in submit().
+ */
+int PlanetMapWorkers::getThreadCount() const {
+    return mThreadCount ? mThreadCount : 1;
+}
+
+int PlanetMapWorkers::getPendingCount() {
+    mSync->lock();
+    int pending = mPending;
+    mSync->unlock();
+    return pending;
+}
+
+void PlanetMapWorkers::run(Job* job) {
+    if (!job->mCancelled) {
+        job->run();
+    }
+}
+
+void PlanetMapWorkers::work() {
+    mSync->lock();
+    while (true) {
+        while (!mExit && mQueue.empty()) {
+            mSync->wait(mSync->mCondition);
+        }
+        if (mExit) break;
+
+        Job* job = mQueue.front();
+        mQueue.pop_front();
+
+        // Run job outside of the lock.
+        mSync->unlock();
+        run(job);
+        mSync->lock();
+
+        mFinished.push_back(job);
+        if (!--mPending) {
+            mSync->broadcast(mSync->mIdle);
+        }
+    }
+    mSync->unlock();
+}
+
+};
@@ -0,0 +1,66 @@
+/*
+ *  PlanetMapWorkers.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetMapWorkers_H
+#define PlanetMapWorkers_H
+
+#include <list>
+
+namespace NFSpace {
+
+    /**
+     * Pool of worker threads for building map tiles on the CPU.
+     *
+     * Jobs are picked up in FIFO order. Finished jobs are parked on a completion queue until
+     * the main thread collects them. Jobs must not touch the scene graph or any GPU resources.
+     * If no thread can be started, submit() runs jobs on the caller's thread instead.
+     *
+     * Threads are pthreads, or Win32 threads with condition variables (Vista and later).
+     */
+    class PlanetMapWorkers {
+    public:
+        class Job {
+        public:
+            Job() : mCancelled(false) {};
+            virtual ~Job() {};
+            virtual void run() = 0;
+
+            // Set from the main thread. A cancelled job is skipped if it has not started yet.
+            volatile bool mCancelled;
+        };
+        typedef std::list<Job*> JobList;
+
+        PlanetMapWorkers(int threads);
+        ~PlanetMapWorkers();
+
+        void submit(Job* job);
+        void collect(JobList& finished);
+        void finish();
+
+        int getThreadCount() const;
+        int getPendingCount();
+
+    protected:
+        // Platform threads and locks, see PlanetMapWorkers.cpp.
+        struct Sync;
+
+        static void run(Job* job);
+        void work();
+
+        int mThreadCount;
+        Sync* mSync;
+
+        JobList mQueue;
+        JobList mFinished;
+        int mPending;
+        bool mExit;
+    };
+
+};
+
+#endif
@@ -0,0 +1,250 @@
+/*
+ *  PlanetNormalMapper.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetNormalMapper.h"
+#include "PlanetCube.h"
+
+#include "EngineState.h"
+#include "Utility.h"
+
+#include "Ogre/OgreBitwise.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NF_NORMALMAPPER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define NF_NORMALMAPPER_AVX2
+#include <immintrin.h>
+#endif
+
+namespace NFSpace {
+
+namespace {
+
+    /**
+     * Per tile constants of normalMapper_FP.
+     */
+    struct NormalParams {
+        float heightScale;
+        float inverseSampleDistance;
+        // faceTransform, row major.
+        float transform[9];
+        // s coordinate of the first column and step per column.
+        float s;
+        float sStep;
+    };
+
+    /**
+     * Vector operations the row kernel is written in. One set per instruction set.
+     */
+    struct ScalarOps {
+        typedef float V;
+        enum { WIDTH = 1 };
+        static inline V load(const float* p) { return *p; }
+        static inline void store(float* p, V a) { *p = a; }
+        static inline V set(float a) { return a; }
+        static inline V ramp(float a, float) { return a; }
+        static inline V add(V a, V b) { return a + b; }
+        static inline V sub(V a, V b) { return a - b; }
+        static inline V mul(V a, V b) { return a * b; }
+        static inline V div(V a, V b) { return a / b; }
+        static inline V sqrt(V a) { return sqrtf(a); }
+    };
+
+#ifdef NF_NORMALMAPPER_SSE2
+    struct SSE2Ops {
+        typedef __m128 V;
+        enum { WIDTH = 4 };
+        static inline V load(const float* p) { return _mm_loadu_ps(p); }
+        static inline void store(float* p, V a) { _mm_storeu_ps(p, a); }
+        static inline V set(float a) { return _mm_set1_ps(a); }
+        static inline V ramp(float a, float step) { return _mm_setr_ps(a, a + step, a + 2 * step, a + 3 * step); }
+        static inline V add(V a, V b) { return _mm_add_ps(a, b); }
+        static inline V sub(V a, V b) { return _mm_sub_ps(a, b); }
+        static inline V mul(V a, V b) { return _mm_mul_ps(a, b); }
+        static inline V div(V a, V b) { return _mm_div_ps(a, b); }
+        static inline V sqrt(V a) { return _mm_sqrt_ps(a); }
+    };
+#endif
+
+#ifdef NF_NORMALMAPPER_AVX2
+    struct AVX2Ops {
+        typedef __m256 V;
+        enum { WIDTH = 8 };
+        static inline V load(const float* p) { return _mm256_loadu_ps(p); }
+        static inline void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+        static inline V set(float a) { return _mm256_set1_ps(a); }
+        static inline V ramp(float a, float step) {
+            return _mm256_setr_ps(a, a + step, a + 2 * step, a + 3 * step,
+                                  a + 4 * step, a + 5 * step, a + 6 * step, a + 7 * step);
+        }
+        static inline V add(V a, V b) { return _mm256_add_ps(a, b); }
+        static inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+        static inline V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        static inline V div(V a, V b) { return _mm256_div_ps(a, b); }
+        static inline V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    };
+#endif
+
+    /**
+     * Port of normalMapper_FP for columns [column, end) of one row, WIDTH texels at a time.
+     * Row pointers point at the first non-border texel. Returns the first column not done.
+     */
+    template<class Ops>
+    int normalRow(const NormalParams& p, const float* above, const float* row, const float* below,
+                  float t, float* out, int column, int end) {
+        typedef typename Ops::V V;
+
+        const V one = Ops::set(1.0f), two = Ops::set(2.0f);
+        const V heightScale = Ops::set(p.heightScale);
+        const V inverseSampleDistance = Ops::set(p.inverseSampleDistance);
+        const V tt = Ops::set(t);
+
+        for (; column + Ops::WIDTH <= end; column += Ops::WIDTH) {
+            // Central differences.
+            V xDifference = Ops::sub(Ops::load(row + column + 1), Ops::load(row + column - 1));
+            V yDifference = Ops::sub(Ops::load(below + column), Ops::load(above + column));
+
+            // (s,t,1) coordinate system.
+            V s = Ops::ramp(p.s + column * p.sStep, p.sStep);
+            V iw = Ops::div(one, Ops::sqrt(Ops::add(Ops::add(Ops::mul(s, s), Ops::mul(tt, tt)), one)));
+            V h = Ops::add(one, Ops::mul(heightScale, Ops::load(row + column)));
+
+            V st = Ops::mul(s, tt);
+            V iw2 = Ops::mul(iw, iw);
+            V iw3 = Ops::mul(iw2, iw);
+            V hiw = Ops::mul(h, iw);
+            V hiw3 = Ops::mul(h, iw3);
+            V sthiw3 = Ops::mul(st, hiw3);
+
+            // Jacobian columns.
+            V j00 = Ops::mul(hiw, Ops::sub(one, Ops::mul(Ops::mul(s, s), iw2)));
+            V j01 = Ops::sub(Ops::set(0.0f), sthiw3);
+            V j02 = Ops::sub(Ops::set(0.0f), Ops::mul(s, hiw3));
+            V j11 = Ops::mul(hiw, Ops::sub(one, Ops::mul(Ops::mul(tt, tt), iw2)));
+            V j12 = Ops::sub(Ops::set(0.0f), Ops::mul(tt, hiw3));
+            V j20 = Ops::mul(heightScale, Ops::mul(s, iw));
+            V j21 = Ops::mul(heightScale, Ops::mul(tt, iw));
+            V j22 = Ops::mul(heightScale, iw);
+
+            // Tangents: jacobian * (2, 0, dx / d), jacobian * (0, 2, -dy / d).
+            V dx = Ops::mul(xDifference, inverseSampleDistance);
+            V dy = Ops::mul(yDifference, inverseSampleDistance);
+            V ax = Ops::add(Ops::mul(two, j00), Ops::mul(j20, dx));
+            V ay = Ops::add(Ops::mul(two, j01), Ops::mul(j21, dx));
+            V az = Ops::add(Ops::mul(two, j02), Ops::mul(j22, dx));
+            V bx = Ops::sub(Ops::mul(two, j01), Ops::mul(j20, dy));
+            V by = Ops::sub(Ops::mul(two, j11), Ops::mul(j21, dy));
+            V bz = Ops::sub(Ops::mul(two, j12), Ops::mul(j22, dy));
+
+            // Cross product, then into planet space.
+            V nx = Ops::sub(Ops::mul(ay, bz), Ops::mul(az, by));
+            V ny = Ops::sub(Ops::mul(az, bx), Ops::mul(ax, bz));
+            V nz = Ops::sub(Ops::mul(ax, by), Ops::mul(ay, bx));
+
+            const float* m = p.transform;
+            V mx = Ops::add(Ops::add(Ops::mul(Ops::set(m[0]), nx), Ops::mul(Ops::set(m[1]), ny)), Ops::mul(Ops::set(m[2]), nz));
+            V my = Ops::add(Ops::add(Ops::mul(Ops::set(m[3]), nx), Ops::mul(Ops::set(m[4]), ny)), Ops::mul(Ops::set(m[5]), nz));
+            V mz = Ops::add(Ops::add(Ops::mul(Ops::set(m[6]), nx), Ops::mul(Ops::set(m[7]), ny)), Ops::mul(Ops::set(m[8]), nz));
+            V length = Ops::sqrt(Ops::add(Ops::add(Ops::mul(mx, mx), Ops::mul(my, my)), Ops::mul(mz, mz)));
+
+            // Shade with the fixed light direction.
+            V shade = Ops::sub(Ops::mul(Ops::add(mx, my), Ops::set(.707f * .866f)), Ops::mul(mz, Ops::set(.5f)));
+            Ops::store(out + column, Ops::div(shade, length));
+        }
+        return column;
+    }
+
+};
+
+PlanetNormalMapper::PlanetNormalMapper(int size, int border)
+: mSize(size), mBorder(border) {
+    // Central differences need one texel on each side.
+    assert(border >= 1);
+    mFullSize = mSize + 2 * mBorder;
+    mHeightScale = getReal("planet.height") / getReal("planet.radius");
+}
+
+PlanetNormalMapper::~PlanetNormalMapper() {
+}
+
+void PlanetNormalMapper::filter(int face, int lod, int x, int y, const float* heights, float* normals) const {
+    filterRows(face, lod, x, y, heights, normals, 0, mSize);
+}
+
+/**
+ * Filter output rows [begin, end) into normals, starting at its first row.
+ * Only reads the height rows around them.
+ */
+void PlanetNormalMapper::filterRows(int face, int lod, int x, int y, const float* heights, float* normals, int begin, int end) const {
+    NormalParams p;
+    p.heightScale = mHeightScale;
+    // See PlanetFilter for the sample distance.
+    p.inverseSampleDistance = ((mBorder + mSize) << lod) * .25f;
+
+    // Face transform with its vertical axis flipped, as passed to normalMapper_FP.
+    Matrix3 faceTransform = PlanetCube::getFaceTransform(face);
+    for (int i = 0; i < 3; ++i) {
+        p.transform[i * 3]     = faceTransform[i][0];
+        p.transform[i * 3 + 1] = -faceTransform[i][1];
+        p.transform[i * 3 + 2] = faceTransform[i][2];
+    }
+
+    // Tile's position in the virtual cubemap, see PlanetFilter::initVertexData.
+    Real tileSize = 2.0 / (1 << lod);
+    Real borderSize = (Real(mBorder) / mSize) * tileSize;
+    Real left = -1.f + tileSize * x - borderSize;
+    Real bottom = -1.f + tileSize * ((1 << lod) - y - 1) - borderSize;
+    Real extent = tileSize + borderSize * 2.0;
+    Real top = bottom + extent;
+
+    // Texel centers, offset to the first non-border texel.
+    Real step = extent / mFullSize;
+    p.sStep = step;
+    p.s = left + step * (mBorder + 0.5f);
+
+    for (int row = begin; row < end; ++row) {
+        const float* center = heights + (row + mBorder) * mFullSize + mBorder;
+        const float* above = center - mFullSize;
+        const float* below = center + mFullSize;
+        float t = top - step * (row + mBorder + 0.5f);
+        float* out = normals + (row - begin) * mSize;
+
+        int column = 0;
+#if defined(NF_NORMALMAPPER_AVX2)
+        column = normalRow<AVX2Ops>(p, above, center, below, t, out, column, mSize);
+#endif
+#if defined(NF_NORMALMAPPER_SSE2)
+        column = normalRow<SSE2Ops>(p, above, center, below, t, out, column, mSize);
+#endif
+        normalRow<ScalarOps>(p, above, center, below, t, out, column, mSize);
+    }
+}
+
+Image PlanetNormalMapper::allocImage() const {
+    PixelFormat pf = PF_FLOAT16_RGB;
+    uchar* data = OGRE_ALLOC_T(uchar, mSize * mSize * PixelUtil::getNumElemBytes(pf), MEMCATEGORY_GENERAL);
+    return Image().loadDynamicImage(data, mSize, mSize, 1, pf, false, 1, 0);
+}
+
+/**
+ * Convert image rows [begin, end) from normals, starting at its first row.
+ */
+void PlanetNormalMapper::saveRows(const float* normals, Image& image, int begin, int end) const {
+    unsigned short* pOut = (unsigned short*)image.getData() + begin * mSize * 3;
+
+    for (int i = 0; i < (end - begin) * mSize; ++i) {
+        unsigned short shade = Bitwise::floatToHalf(normals[i]);
+        *pOut++ = shade;
+        *pOut++ = shade;
+        *pOut++ = shade;
+    }
+}
+
+};
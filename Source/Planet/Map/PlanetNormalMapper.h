@@ -0,0 +1,49 @@
+/*
+ *  PlanetNormalMapper.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetNormalMapper_H
+#define PlanetNormalMapper_H
+
+#include <Ogre/Ogre.h>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * CPU implementation of the Planet/NormalMapper filter pass.
+     *
+     * Reads a height workspace (fullSize x fullSize floats, top row first, as produced by
+     * PlanetMapRasterizer) and writes the shaded normal map for the tile without its border
+     * (size x size floats). Uses the same face transform, height scale and sample distance as
+     * the PlanetFilter set up for normalMapper_FP.
+     *
+     * Rows are processed with SSE2, or AVX2 when the compiler targets it, with a scalar
+     * fallback for other platforms and leftover columns.
+     */
+    class PlanetNormalMapper {
+    public:
+        PlanetNormalMapper(int size, int border);
+        ~PlanetNormalMapper();
+
+        void filter(int face, int lod, int x, int y, const float* heights, float* normals) const;
+        void filterRows(int face, int lod, int x, int y, const float* heights, float* normals, int begin, int end) const;
+
+        Image allocImage() const;
+        void saveRows(const float* normals, Image& image, int begin, int end) const;
+
+    protected:
+        int mSize;
+        int mBorder;
+        int mFullSize;
+        Real mHeightScale;
+    };
+
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ *  PlanetReadback.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetReadback.h"
+#include "PlanetReadbackGL.h"
+
+#include "Utility.h"
+
+namespace NFSpace {
+
+/**
+ * Pick a readback backend. GL needs the OpenGL render system with pixel buffer objects,
+ * anything else gets CPU.
+ */
+PlanetReadback* PlanetReadback::create(const String& backend, int slots) {
+    RenderSystem* renderSystem = Root::getSingleton().getRenderSystem();
+    if (backend == "GL" && renderSystem && renderSystem->getName().find("OpenGL") != String::npos &&
+        PlanetReadbackGL::isSupported()) {
+        return new PlanetReadbackGL(slots);
+    }
+    if (backend != "CPU") {
+        log("Readback backend " + backend + " is not available, using CPU.");
+    }
+    return new PlanetReadbackCPU(slots);
+}
+
+PlanetReadbackCPU::PlanetReadbackCPU(int slots)
+: mImages(slots), mBusy(slots, false) {
+}
+
+PlanetReadbackCPU::~PlanetReadbackCPU() {
+    for (size_t i = 0; i < mBusy.size(); ++i) {
+        cancel(i);
+    }
+}
+
+PlanetReadback::Ticket PlanetReadbackCPU::issue(RenderTexture* source, PixelFormat format) {
+    for (size_t i = 0; i < mBusy.size(); ++i) {
+        if (mBusy[i]) continue;
+
+        size_t width = source->getWidth(), height = source->getHeight();
+        uchar* data = OGRE_ALLOC_T(uchar, width * height * PixelUtil::getNumElemBytes(format), MEMCATEGORY_GENERAL);
+        PixelBox pb(width, height, 1, format, data);
+        source->copyContentsToMemory(pb, RenderTarget::FB_AUTO);
+
+        mImages[i] = Image().loadDynamicImage(data, width, height, 1, format, false, 1, 0);
+        mBusy[i] = true;
+        return i;
+    }
+    return -1;
+}
+
+bool PlanetReadbackCPU::poll(Ticket ticket) {
+    return mBusy[ticket];
+}
+
+Image PlanetReadbackCPU::map(Ticket ticket) {
+    assert(mBusy[ticket]);
+    Image image = mImages[ticket];
+    mImages[ticket] = Image();
+    mBusy[ticket] = false;
+    return image;
+}
+
+void PlanetReadbackCPU::cancel(Ticket ticket) {
+    if (!mBusy[ticket]) return;
+    OGRE_FREE(mImages[ticket].getData(), MEMCATEGORY_GENERAL);
+    mImages[ticket] = Image();
+    mBusy[ticket] = false;
+}
+
+};
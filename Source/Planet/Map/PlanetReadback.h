@@ -0,0 +1,65 @@
+/*
+ *  PlanetReadback.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetReadback_H
+#define PlanetReadback_H
+
+#include <Ogre/Ogre.h>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Asynchronous copy of a render target into system memory.
+     *
+     * issue() starts a copy and returns a ticket, or -1 if no more copies can be in flight.
+     * poll() says whether a ticket's copy has landed, after which map() hands over the pixels
+     * as a new image the caller owns (free with OGRE_FREE), or an empty image if the copy was
+     * lost; the ticket is spent either way. cancel() drops a ticket instead.
+     * A render target can be drawn into again as soon as its copy has been issued.
+     *
+     * Backends:
+     *     "GL"    ring of pixel pack buffers, polled with fences where available
+     *     "CPU"   copyContentsToMemory, completes immediately (any render system, headless)
+     */
+    class PlanetReadback {
+    public:
+        typedef int Ticket;
+
+        virtual ~PlanetReadback() {};
+
+        virtual Ticket issue(RenderTexture* source, PixelFormat format) = 0;
+        virtual bool poll(Ticket ticket) = 0;
+        virtual Image map(Ticket ticket) = 0;
+        virtual void cancel(Ticket ticket) = 0;
+
+        static PlanetReadback* create(const String& backend, int slots);
+    };
+
+    /**
+     * Blocking readback, done entirely inside issue().
+     */
+    class PlanetReadbackCPU : public PlanetReadback {
+    public:
+        PlanetReadbackCPU(int slots);
+        virtual ~PlanetReadbackCPU();
+
+        virtual Ticket issue(RenderTexture* source, PixelFormat format);
+        virtual bool poll(Ticket ticket);
+        virtual Image map(Ticket ticket);
+        virtual void cancel(Ticket ticket);
+
+    protected:
+        std::vector<Image> mImages;
+        std::vector<bool> mBusy;
+    };
+
+};
+
+#endif
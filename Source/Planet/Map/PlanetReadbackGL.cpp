@@ -0,0 +1,225 @@
+/*
+ *  PlanetReadbackGL.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+// Before Ogre's headers, whose using directive makes X11's Font ambiguous.
+#if !defined(__APPLE__) && !defined(_WIN32)
+#include <GL/glx.h>
+#endif
+
+#include "PlanetReadbackGL.h"
+
+#include "Utility.h"
+
+namespace NFSpace {
+
+namespace {
+#if !defined(__APPLE__)
+    // Entry points beyond GL 1.1, resolved by loadFunctions() the way Ogre's GLSupport does.
+    PFNGLGENBUFFERSPROC pglGenBuffers = 0;
+    PFNGLDELETEBUFFERSPROC pglDeleteBuffers = 0;
+    PFNGLBINDBUFFERPROC pglBindBuffer = 0;
+    PFNGLBUFFERDATAPROC pglBufferData = 0;
+    PFNGLMAPBUFFERPROC pglMapBuffer = 0;
+    PFNGLUNMAPBUFFERPROC pglUnmapBuffer = 0;
+    PFNGLFENCESYNCPROC pglFenceSync = 0;
+    PFNGLCLIENTWAITSYNCPROC pglClientWaitSync = 0;
+    PFNGLDELETESYNCPROC pglDeleteSync = 0;
+
+    void* getProcAddress(const char* name) {
+#if defined(_WIN32)
+        return (void*)wglGetProcAddress(name);
+#else
+        return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+    }
+
+    template <typename T> bool resolve(T& function, const char* name) {
+        function = (T)getProcAddress(name);
+        return function != 0;
+    }
+
+    #define glGenBuffers pglGenBuffers
+    #define glDeleteBuffers pglDeleteBuffers
+    #define glBindBuffer pglBindBuffer
+    #define glBufferData pglBufferData
+    #define glMapBuffer pglMapBuffer
+    #define glUnmapBuffer pglUnmapBuffer
+#endif
+}
+
+PlanetReadbackGL::PlanetReadbackGL(int slots) : mSlots(slots) {
+    loadFunctions();
+    for (std::vector<Slot>::iterator it = mSlots.begin(); it != mSlots.end(); ++it) {
+        it->mBusy = false;
+        it->mCapacity = 0;
+        glGenBuffers(1, &it->mBuffer);
+#ifdef __APPLE__
+        glGenFencesAPPLE(1, &it->mFence);
+#else
+        it->mSync = 0;
+#endif
+    }
+}
+
+PlanetReadbackGL::~PlanetReadbackGL() {
+    for (std::vector<Slot>::iterator it = mSlots.begin(); it != mSlots.end(); ++it) {
+        glDeleteBuffers(1, &it->mBuffer);
+#ifdef __APPLE__
+        glDeleteFencesAPPLE(1, &it->mFence);
+#else
+        releaseFence(*it);
+#endif
+    }
+}
+
+/**
+ * Whether pixel pack buffers can be used. Needs a current GL context.
+ */
+bool PlanetReadbackGL::isSupported() {
+    return loadFunctions();
+}
+
+bool PlanetReadbackGL::loadFunctions() {
+#ifdef __APPLE__
+    return true;
+#else
+    static bool loaded = false, supported = false;
+    if (!loaded) {
+        loaded = true;
+        supported = resolve(pglGenBuffers, "glGenBuffers") &&
+                    resolve(pglDeleteBuffers, "glDeleteBuffers") &&
+                    resolve(pglBindBuffer, "glBindBuffer") &&
+                    resolve(pglBufferData, "glBufferData") &&
+                    resolve(pglMapBuffer, "glMapBuffer") &&
+                    resolve(pglUnmapBuffer, "glUnmapBuffer");
+
+        // Optional, poll() falls back to blocking in map() without it.
+        if (!(resolve(pglFenceSync, "glFenceSync") &&
+              resolve(pglClientWaitSync, "glClientWaitSync") &&
+              resolve(pglDeleteSync, "glDeleteSync"))) {
+            pglFenceSync = 0;
+            log("PlanetReadbackGL: ARB_sync not available, readbacks will block.");
+        }
+    }
+    return supported;
+#endif
+}
+
+void PlanetReadbackGL::releaseFence(Slot& slot) {
+#if !defined(__APPLE__)
+    if (slot.mSync) {
+        pglDeleteSync(slot.mSync);
+        slot.mSync = 0;
+    }
+#endif
+}
+
+PlanetReadback::Ticket PlanetReadbackGL::issue(RenderTexture* source, PixelFormat format) {
+    GLenum type;
+    switch (format) {
+        case PF_FLOAT16_RGBA:
+            type = GL_HALF_FLOAT_ARB;
+            break;
+        case PF_FLOAT32_RGBA:
+            type = GL_FLOAT;
+            break;
+        default:
+            OGRE_EXCEPT(Exception::ERR_INVALIDPARAMS, "Unsupported readback format", "PlanetReadbackGL::issue");
+    }
+
+    for (size_t i = 0; i < mSlots.size(); ++i) {
+        Slot& slot = mSlots[i];
+        if (slot.mBusy) continue;
+
+        slot.mFormat = format;
+        slot.mWidth = source->getWidth();
+        slot.mHeight = source->getHeight();
+        size_t size = slot.mWidth * slot.mHeight * PixelUtil::getNumElemBytes(format);
+
+        // Bind the target's FBO the same way a render of it does. Going through _setViewport
+        // rather than _setRenderTarget keeps the render system's active viewport in step,
+        // so Ogre rebinds its own target for the next viewport it draws. Ogre leaves the
+        // FBO's read buffer unset.
+        Root::getSingleton().getRenderSystem()->_setViewport(source->getViewport(0));
+        glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+        // With a pack buffer bound, glReadPixels just queues the copy.
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.mBuffer);
+        if (slot.mCapacity < size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+            slot.mCapacity = size;
+        }
+        glReadPixels(0, 0, slot.mWidth, slot.mHeight, GL_RGBA, type, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glReadBuffer(GL_NONE);
+
+#ifdef __APPLE__
+        glSetFenceAPPLE(slot.mFence);
+#else
+        if (pglFenceSync) {
+            slot.mSync = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+#endif
+        slot.mBusy = true;
+        return i;
+    }
+    return -1;
+}
+
+bool PlanetReadbackGL::poll(Ticket ticket) {
+    Slot& slot = mSlots[ticket];
+    if (!slot.mBusy) return false;
+#ifdef __APPLE__
+    return glTestFenceAPPLE(slot.mFence);
+#else
+    if (!slot.mSync) return true;
+    GLenum status = pglClientWaitSync(slot.mSync, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+#endif
+}
+
+/**
+ * Returns an empty image if the buffer couldn't be mapped, the copy is lost then.
+ */
+Image PlanetReadbackGL::map(Ticket ticket) {
+    Slot& slot = mSlots[ticket];
+    assert(slot.mBusy);
+    slot.mBusy = false;
+    releaseFence(slot);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.mBuffer);
+    void* mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        log("PlanetReadbackGL: could not map pixel pack buffer.");
+        return Image();
+    }
+
+    size_t size = slot.mWidth * slot.mHeight * PixelUtil::getNumElemBytes(slot.mFormat);
+    uchar* data = OGRE_ALLOC_T(uchar, size, MEMCATEGORY_GENERAL);
+    memcpy(data, mapped, size);
+    // Contents can be corrupted while mapped (e.g. a mode switch), drop them then too.
+    bool intact = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!intact) {
+        OGRE_FREE(data, MEMCATEGORY_GENERAL);
+        log("PlanetReadbackGL: pixel pack buffer was lost while mapped.");
+        return Image();
+    }
+
+    return Image().loadDynamicImage(data, slot.mWidth, slot.mHeight, 1, slot.mFormat, false, 1, 0);
+}
+
+void PlanetReadbackGL::cancel(Ticket ticket) {
+    // The copy may still land in the buffer, which is harmless: it's overwritten when reused.
+    mSlots[ticket].mBusy = false;
+    releaseFence(mSlots[ticket]);
+}
+
+};
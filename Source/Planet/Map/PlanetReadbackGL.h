@@ -0,0 +1,74 @@
+/*
+ *  PlanetReadbackGL.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetReadbackGL_H
+#define PlanetReadbackGL_H
+
+#include "PlanetReadback.h"
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#else
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+namespace NFSpace {
+
+    /**
+     * Readback through a ring of pixel pack buffers, for the OpenGL render system.
+     *
+     * issue() binds the render target's framebuffer and queues a glReadPixels into a free
+     * buffer, which returns without waiting for the GPU. A fence after it (APPLE_fence on
+     * OS X, ARB_sync elsewhere) tells poll() when the copy is done, so map() doesn't stall.
+     * Without fences, poll() reports copies done straight away and map() blocks instead.
+     *
+     * Buffer object and sync entry points are looked up at run time except on OS X, where the
+     * GL framework links them. isSupported() says whether the buffer objects were found.
+     */
+    class PlanetReadbackGL : public PlanetReadback {
+    public:
+        PlanetReadbackGL(int slots);
+        virtual ~PlanetReadbackGL();
+
+        virtual Ticket issue(RenderTexture* source, PixelFormat format);
+        virtual bool poll(Ticket ticket);
+        virtual Image map(Ticket ticket);
+        virtual void cancel(Ticket ticket);
+
+        static bool isSupported();
+
+    protected:
+        struct Slot {
+            bool mBusy;
+            GLuint mBuffer;
+            size_t mCapacity;
+#ifdef __APPLE__
+            GLuint mFence;
+#else
+            GLsync mSync;
+#endif
+
+            PixelFormat mFormat;
+            size_t mWidth;
+            size_t mHeight;
+        };
+
+        static bool loadFunctions();
+        void releaseFence(Slot& slot);
+
+        std::vector<Slot> mSlots;
+    };
+
+};
+
+#endif
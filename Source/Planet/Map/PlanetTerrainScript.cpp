@@ -0,0 +1,326 @@
+/*
+ *  PlanetTerrainScript.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetTerrainScript.h"
+
+#include "Utility.h"
+
+#include <cstdlib>
+
+namespace NFSpace {
+
+PlanetTerrainScript::PlanetTerrainScript(const String& source, int seed)
+: mSeed(seed), mOutput(-1), mUsesBrushes(false) {
+    // Shuffled lattice hash for the noise, from the planet seed.
+    for (int i = 0; i < 256; ++i) {
+        mPerm[i] = i;
+    }
+    for (int i = 255; i > 0; --i) {
+        int j = randi(seed, i, 0) % (i + 1);
+        unsigned char swap = mPerm[i];
+        mPerm[i] = mPerm[j];
+        mPerm[j] = swap;
+    }
+    for (int i = 0; i < 256; ++i) {
+        mPerm[i + 256] = mPerm[i];
+    }
+
+    compile(source);
+}
+
+PlanetTerrainScript::~PlanetTerrainScript() {
+}
+
+PlanetTerrainScript::Instruction::Instruction()
+: mOp(OP_CONST), mTarget(0), mValue(1.0f), mOctaves(1), mFrequency(1.0f), mAmplitude(1.0f),
+  mGain(0.5f), mLacunarity(2.0f), mOffset(Vector3::ZERO) {
+    mArgs[0] = mArgs[1] = mArgs[2] = 0;
+}
+
+bool PlanetTerrainScript::usesBrushes() const {
+    return mUsesBrushes;
+}
+
+/**
+ * Number of registers, each holding one value per texel, needed by evaluate().
+ */
+int PlanetTerrainScript::getRegisterCount() const {
+    return mProgram.size();
+}
+
+void PlanetTerrainScript::compile(const String& source) {
+    NodeMap nodes;
+
+    StringVector lines = StringUtil::split(source, "\n", 0);
+    for (size_t line = 0; line < lines.size(); ++line) {
+        String code = lines[line];
+        size_t comment = code.find('#');
+        if (comment != String::npos) {
+            code = code.substr(0, comment);
+        }
+
+        StringVector statements = StringUtil::split(code, ";", 0);
+        for (StringVector::iterator it = statements.begin(); it != statements.end(); ++it) {
+            StringVector tokens = StringUtil::split(*it, " \t\r", 0);
+            if (!tokens.empty()) {
+                compileStatement(tokens, line + 1, nodes);
+            }
+        }
+    }
+
+    NodeMap::iterator out = nodes.find("out");
+    if (out == nodes.end()) {
+        error("no 'out' node defined", lines.size());
+    }
+    mOutput = out->second;
+}
+
+void PlanetTerrainScript::compileStatement(const StringVector& tokens, int line, NodeMap& nodes) {
+    Real number;
+    if (tokens.size() < 3 || tokens[1] != "=") {
+        error("expected 'name = op arguments'", line);
+    }
+    if (parseNumber(tokens[0], number)) {
+        error("node name '" + tokens[0] + "' is a number", line);
+    }
+
+    const String& op = tokens[2];
+    int arguments = tokens.size() - 3;
+
+    Instruction instruction;
+    if (op == "brushes") {
+        if (arguments > 1) error("usage: brushes [scale]", line);
+        if (arguments > 0 && !parseNumber(tokens[3], instruction.mValue)) error("bad scale '" + tokens[3] + "'", line);
+        instruction.mOp = OP_BRUSHES;
+        mUsesBrushes = true;
+    }
+    else if (op == "simplex" || op == "fbm" || op == "ridged") {
+        // Leading octave count for the fractal ops.
+        int first = 3;
+        if (op == "simplex") {
+            if (arguments != 2) error("usage: simplex frequency amplitude", line);
+            instruction.mOp = OP_SIMPLEX;
+        }
+        else {
+            if (arguments < 3 || arguments > 5) error("usage: " + op + " octaves frequency amplitude [gain] [lacunarity]", line);
+            if (!parseNumber(tokens[3], number) || number < 1) error("bad octave count '" + tokens[3] + "'", line);
+            instruction.mOp = (op == "fbm") ? OP_FBM : OP_RIDGED;
+            instruction.mOctaves = (int)number;
+            first = 4;
+        }
+
+        Real* parameters[] = { &instruction.mFrequency, &instruction.mAmplitude, &instruction.mGain, &instruction.mLacunarity };
+        for (int i = first; i < (int)tokens.size(); ++i) {
+            if (!parseNumber(tokens[i], *parameters[i - first])) error("bad number '" + tokens[i] + "'", line);
+        }
+
+        // Decorrelate noise nodes from each other.
+        int index = mProgram.size();
+        instruction.mOffset = Vector3(randf(mSeed, index, 1), randf(mSeed, index, 2), randf(mSeed, index, 3)) * 256.0f;
+    }
+    else {
+        int operands;
+        if (op == "add") { instruction.mOp = OP_ADD; operands = 2; }
+        else if (op == "sub") { instruction.mOp = OP_SUB; operands = 2; }
+        else if (op == "mul") { instruction.mOp = OP_MUL; operands = 2; }
+        else if (op == "min") { instruction.mOp = OP_MIN; operands = 2; }
+        else if (op == "max") { instruction.mOp = OP_MAX; operands = 2; }
+        else if (op == "mix") { instruction.mOp = OP_MIX; operands = 3; }
+        else {
+            error("unknown op '" + op + "'", line);
+        }
+        if (arguments != operands) {
+            error("usage: " + op + (operands == 2 ? " a b" : " a b t"), line);
+        }
+
+        for (int i = 0; i < operands; ++i) {
+            instruction.mArgs[i] = compileOperand(tokens[i + 3], line, nodes);
+        }
+    }
+
+    nodes[tokens[0]] = emit(instruction);
+}
+
+/**
+ * Resolve a node name, or emit a constant for a number.
+ */
+int PlanetTerrainScript::compileOperand(const String& token, int line, const NodeMap& nodes) {
+    Instruction instruction;
+    if (parseNumber(token, instruction.mValue)) {
+        instruction.mOp = OP_CONST;
+        return emit(instruction);
+    }
+
+    NodeMap::const_iterator it = nodes.find(token);
+    if (it == nodes.end()) {
+        error("unknown node '" + token + "'", line);
+    }
+    return it->second;
+}
+
+/**
+ * Append an instruction, writing to a fresh register. Returns the register.
+ */
+int PlanetTerrainScript::emit(Instruction& instruction) {
+    instruction.mTarget = mProgram.size();
+    mProgram.push_back(instruction);
+    return instruction.mTarget;
+}
+
+void PlanetTerrainScript::error(const String& message, int line) const {
+    OGRE_EXCEPT(Exception::ERR_INVALIDPARAMS,
+                "Terrain script, line " + StringConverter::toString(line) + ": " + message,
+                "PlanetTerrainScript::compile");
+}
+
+bool PlanetTerrainScript::parseNumber(const String& token, Real& value) {
+    const char* begin = token.c_str();
+    char* end;
+    value = strtod(begin, &end);
+    return end != begin && *end == 0;
+}
+
+/**
+ * Run the program over count texels. Inputs are the brush layer (may be 0 if the script
+ * doesn't use it) and the unit sphere position of each texel. Registers must hold
+ * getRegisterCount() * count floats. Out may alias brushes.
+ */
+void PlanetTerrainScript::evaluate(const float* brushes, const float* x, const float* y, const float* z,
+                                   float* registers, float* out, int count, Real bias) const {
+    for (std::vector<Instruction>::const_iterator it = mProgram.begin(); it != mProgram.end(); ++it) {
+        const Instruction& instruction = *it;
+        float* target = registers + instruction.mTarget * count;
+        const float* a = registers + instruction.mArgs[0] * count;
+        const float* b = registers + instruction.mArgs[1] * count;
+        const float* t = registers + instruction.mArgs[2] * count;
+        float value = instruction.mValue;
+
+        switch (instruction.mOp) {
+            case OP_CONST:
+                for (int i = 0; i < count; ++i) target[i] = value;
+                break;
+            case OP_BRUSHES:
+                for (int i = 0; i < count; ++i) target[i] = brushes[i] * value;
+                break;
+            case OP_SIMPLEX:
+            case OP_FBM:
+            case OP_RIDGED:
+                evaluateNoise(instruction, x, y, z, target, count);
+                break;
+            case OP_ADD:
+                for (int i = 0; i < count; ++i) target[i] = a[i] + b[i];
+                break;
+            case OP_SUB:
+                for (int i = 0; i < count; ++i) target[i] = a[i] - b[i];
+                break;
+            case OP_MUL:
+                for (int i = 0; i < count; ++i) target[i] = a[i] * b[i];
+                break;
+            case OP_MIN:
+                for (int i = 0; i < count; ++i) target[i] = a[i] < b[i] ? a[i] : b[i];
+                break;
+            case OP_MAX:
+                for (int i = 0; i < count; ++i) target[i] = a[i] > b[i] ? a[i] : b[i];
+                break;
+            case OP_MIX:
+                for (int i = 0; i < count; ++i) target[i] = a[i] + (b[i] - a[i]) * t[i];
+                break;
+        }
+    }
+
+    const float* result = registers + mOutput * count;
+    for (int i = 0; i < count; ++i) {
+        out[i] = result[i] + bias;
+    }
+}
+
+/**
+ * Sum octaves of simplex noise. Ridged noise folds every octave into (1 - |n|)^2.
+ */
+void PlanetTerrainScript::evaluateNoise(const Instruction& instruction, const float* x, const float* y, const float* z, float* out, int count) const {
+    const Vector3& offset = instruction.mOffset;
+    Real frequency = instruction.mFrequency;
+    Real amplitude = instruction.mAmplitude;
+    bool ridged = instruction.mOp == OP_RIDGED;
+
+    for (int i = 0; i < count; ++i) {
+        out[i] = 0;
+    }
+    for (int octave = 0; octave < instruction.mOctaves; ++octave) {
+        for (int i = 0; i < count; ++i) {
+            Real n = simplex(x[i] * frequency + offset.x, y[i] * frequency + offset.y, z[i] * frequency + offset.z);
+            if (ridged) {
+                n = 1.0f - fabsf(n);
+                n *= n;
+            }
+            out[i] += n * amplitude;
+        }
+        frequency *= instruction.mLacunarity;
+        amplitude *= instruction.mGain;
+    }
+}
+
+/**
+ * 3D simplex noise in [-1, 1] (after Gustavson, "Simplex noise demystified").
+ */
+Real PlanetTerrainScript::simplex(Real x, Real y, Real z) const {
+    static const float gradients[12][3] = {
+        { 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+        { 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+        { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+    };
+    const Real F3 = 1.0f / 3.0f, G3 = 1.0f / 6.0f;
+
+    // Skew into the simplex lattice and find the containing cell.
+    Real s = (x + y + z) * F3;
+    int i = (int)floorf(x + s), j = (int)floorf(y + s), k = (int)floorf(z + s);
+    Real t = (i + j + k) * G3;
+    Real x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+
+    // Pick the simplex within the cell by ranking the offsets.
+    int i1, j1, k1, i2, j2, k2;
+    if (x0 >= y0) {
+        if (y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+        else               { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+    }
+    else {
+        if (y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+        else if (x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+        else               { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    }
+
+    Real corners[4][3] = {
+        { x0, y0, z0 },
+        { x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3 },
+        { x0 - i2 + 2.0f * G3, y0 - j2 + 2.0f * G3, z0 - k2 + 2.0f * G3 },
+        { x0 - 1.0f + 3.0f * G3, y0 - 1.0f + 3.0f * G3, z0 - 1.0f + 3.0f * G3 },
+    };
+    int ii = i & 255, jj = j & 255, kk = k & 255;
+    int hashes[4] = {
+        mPerm[ii + mPerm[jj + mPerm[kk]]],
+        mPerm[ii + i1 + mPerm[jj + j1 + mPerm[kk + k1]]],
+        mPerm[ii + i2 + mPerm[jj + j2 + mPerm[kk + k2]]],
+        mPerm[ii + 1 + mPerm[jj + 1 + mPerm[kk + 1]]],
+    };
+
+    // Sum the radially attenuated gradient ramps of the four corners.
+    Real n = 0;
+    for (int c = 0; c < 4; ++c) {
+        const Real* d = corners[c];
+        Real falloff = 0.6f - d[0] * d[0] - d[1] * d[1] - d[2] * d[2];
+        if (falloff > 0) {
+            const float* g = gradients[hashes[c] % 12];
+            falloff *= falloff;
+            n += falloff * falloff * (g[0] * d[0] + g[1] * d[1] + g[2] * d[2]);
+        }
+    }
+    return 32.0f * n;
+}
+
+};
@@ -0,0 +1,110 @@
+/*
+ *  PlanetTerrainScript.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetTerrainScript_H
+#define PlanetTerrainScript_H
+
+#include <Ogre/Ogre.h>
+#include <map>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Terrain description language for PlanetDescriptor::script.
+     *
+     * A script is a list of statements, separated by newlines or ';', each defining a node:
+     *
+     *     # Craters on rolling hills.
+     *     hills = fbm 6 2 0.1
+     *     peaks = ridged 5 4 0.05 0.5 2
+     *     land = mix hills peaks 0.3
+     *     craters = brushes
+     *     out = add land craters
+     *
+     * Generators:
+     *     simplex frequency amplitude
+     *     fbm     octaves frequency amplitude [gain = 0.5] [lacunarity = 2]
+     *     ridged  octaves frequency amplitude [gain = 0.5] [lacunarity = 2]
+     *     brushes [scale = 1]        the planet's scattered brush layer
+     *
+     * Blend ops, whose operands are node names or numbers:
+     *     add a b, sub a b, mul a b, min a b, max a b, mix a b t
+     *
+     * Noise is sampled on the unit sphere, so it is seamless across cube faces. The node
+     * named 'out' is the terrain height, as an offset from the map's fill level.
+     *
+     * The script is compiled once into a flat program over registers, which is then run
+     * over a whole block of texels at a time. Throws an Ogre exception on syntax errors.
+     */
+    class PlanetTerrainScript {
+    public:
+        PlanetTerrainScript(const String& source, int seed);
+        ~PlanetTerrainScript();
+
+        void evaluate(const float* brushes, const float* x, const float* y, const float* z,
+                      float* registers, float* out, int count, Real bias) const;
+
+        bool usesBrushes() const;
+        int getRegisterCount() const;
+
+    protected:
+        enum {
+            OP_CONST,
+            OP_BRUSHES,
+            OP_SIMPLEX,
+            OP_FBM,
+            OP_RIDGED,
+            OP_ADD,
+            OP_SUB,
+            OP_MUL,
+            OP_MIN,
+            OP_MAX,
+            OP_MIX,
+        };
+
+        struct Instruction {
+            Instruction();
+
+            int mOp;
+            int mTarget;
+            int mArgs[3];
+
+            Real mValue;
+            int mOctaves;
+            Real mFrequency;
+            Real mAmplitude;
+            Real mGain;
+            Real mLacunarity;
+            Vector3 mOffset;
+        };
+        typedef std::map<String, int> NodeMap;
+
+        void compile(const String& source);
+        void compileStatement(const StringVector& tokens, int line, NodeMap& nodes);
+        int compileOperand(const String& token, int line, const NodeMap& nodes);
+        int emit(Instruction& instruction);
+        void error(const String& message, int line) const;
+
+        static bool parseNumber(const String& token, Real& value);
+
+        void evaluateNoise(const Instruction& instruction, const float* x, const float* y, const float* z, float* out, int count) const;
+        Real simplex(Real x, Real y, Real z) const;
+
+        int mSeed;
+        int mOutput;
+        bool mUsesBrushes;
+        std::vector<Instruction> mProgram;
+        unsigned char mPerm[512];
+    };
+
+};
+
+#endif
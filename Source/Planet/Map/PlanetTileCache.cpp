@@ -0,0 +1,303 @@
+/*
+ *  PlanetTileCache.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetTileCache.h"
+
+#include "PlanetHalfCodec.h"
+#include "Utility.h"
+
+#include <fstream>
+#include <errno.h>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+namespace NFSpace {
+
+namespace {
+    // Bump when the file layout or tile contents change.
+    const uint32 TILE_MAGIC = 0x4C54464E; // "NFTL"
+    const uint32 TILE_VERSION = 3;
+
+    // 64-bit FNV-1a.
+    void hashBytes(uint64& hash, const void* data, size_t size) {
+        const uchar* bytes = (const uchar*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    void hashInt(uint64& hash, uint32 value) {
+        // Fixed byte order, so keys don't depend on the host.
+        uchar bytes[4] = { (uchar)value, (uchar)(value >> 8), (uchar)(value >> 16), (uchar)(value >> 24) };
+        hashBytes(hash, bytes, 4);
+    }
+
+    void hashReal(uint64& hash, Real value) {
+        float single = value;
+        uint32 bits;
+        memcpy(&bits, &single, 4);
+        hashInt(hash, bits);
+    }
+
+    void hashString(uint64& hash, const String& value) {
+        hashInt(hash, value.size());
+        hashBytes(hash, value.data(), value.size());
+    }
+
+    bool makeDirectory(const String& path) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    /**
+     * Names of the loose tile files in a directory.
+     */
+    bool listTiles(const String& path, std::vector<String>& files) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA((path + "/*.tile").c_str(), &entry);
+        if (find == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+        do {
+            files.push_back(entry.cFileName);
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+#else
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return false;
+        while (struct dirent* entry = readdir(dir)) {
+            String name = entry->d_name;
+            if (StringUtil::endsWith(name, ".tile")) {
+                files.push_back(name);
+            }
+        }
+        closedir(dir);
+#endif
+        return true;
+    }
+}
+
+PlanetTileCache::PlanetTileCache(const String& path, const PlanetDescriptor& descriptor, const String& settings)
+: mStored(0) {
+    mDirectory = path + "/" + getKey(descriptor, settings);
+    mPackPath = getPackPath(path, descriptor, settings);
+    mPack.open(mPackPath);
+
+    mWritable = makeDirectory(path) && makeDirectory(mDirectory);
+    if (!mWritable) {
+        log("Tile cache " + mDirectory + " is not writable, only reading from it.");
+    }
+
+    // Loose tiles left by earlier runs count towards packing too.
+    std::vector<String> files;
+    listTiles(mDirectory, files);
+    mStored = files.size();
+}
+
+PlanetTileCache::~PlanetTileCache() {
+}
+
+const String& PlanetTileCache::getDirectory() const {
+    return mDirectory;
+}
+
+/**
+ * Number of loose tiles, stored since the cache was last packed.
+ */
+int PlanetTileCache::getStoredCount() const {
+    return mStored;
+}
+
+/**
+ * Stable key for a planet's tiles: the same descriptor and settings always give the
+ * same hash, across runs and hosts.
+ */
+uint64 PlanetTileCache::hash(const PlanetDescriptor& descriptor, const String& settings) {
+    uint64 hash = 14695981039346656037ULL;
+    hashInt(hash, TILE_VERSION);
+    hashString(hash, descriptor.script);
+    hashInt(hash, descriptor.seed);
+    hashInt(hash, descriptor.brushes);
+    hashReal(hash, descriptor.radius);
+    hashReal(hash, descriptor.height);
+    hashInt(hash, descriptor.baseMapSize);
+    hashReal(hash, descriptor.baseMapThreshold);
+    hashString(hash, settings);
+    return hash;
+}
+
+/**
+ * Map settings that change what tiles look like, for hash().
+ */
+String PlanetTileCache::getSettings(const String& backend, int textureSize, bool upsample) {
+    std::ostringstream settings;
+    settings << backend << " " << textureSize << " " << upsample;
+    return settings.str();
+}
+
+/**
+ * Where a cache at path keeps the pack for this planet. Lets tools write packs the game finds.
+ */
+String PlanetTileCache::getPackPath(const String& path, const PlanetDescriptor& descriptor, const String& settings) {
+    return path + "/" + getKey(descriptor, settings) + ".pack";
+}
+
+String PlanetTileCache::getKey(const PlanetDescriptor& descriptor, const String& settings) {
+    // Spelled out, printf has no portable 64-bit format.
+    static const char digits[] = "0123456789abcdef";
+    uint64 value = hash(descriptor, settings);
+    char key[17];
+    for (int i = 15; i >= 0; --i) {
+        key[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    key[16] = 0;
+    return key;
+}
+
+String PlanetTileCache::getTilePath(int face, int lod, int x, int y) const {
+    std::ostringstream path;
+    path << mDirectory << "/" << face << "_" << lod << "_" << x << "_" << y << ".tile";
+    return path.str();
+}
+
+/**
+ * Read a tile if it's cached. Mapped images belong to the pack, otherwise they're allocated
+ * with OGRE_ALLOC_T and owned by the caller.
+ */
+bool PlanetTileCache::load(int face, int lod, int x, int y, Image& heightImage, Image& normalImage, bool& mapped) {
+    mapped = mPack.find(face, lod, x, y, heightImage, normalImage);
+    if (mapped) return true;
+    return loadFile(getTilePath(face, lod, x, y), heightImage, normalImage);
+}
+
+bool PlanetTileCache::loadFile(const String& path, Image& heightImage, Image& normalImage) {
+    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+    if (!stream) return false;
+
+    uint32 header[2];
+    stream.read((char*)header, sizeof(header));
+    if (!stream || header[0] != TILE_MAGIC || header[1] != TILE_VERSION) return false;
+
+    if (!readImage(stream, heightImage)) return false;
+    if (!readImage(stream, normalImage)) {
+        OGRE_FREE(heightImage.getData(), MEMCATEGORY_GENERAL);
+        heightImage = Image();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write a tile whose images are encoded with PlanetHalfCodec. Goes to a temporary file first,
+ * so a partial write is never picked up. Only touches the tile's own file, so it may run on
+ * a worker thread; the caller counts written tiles with addStored().
+ */
+bool PlanetTileCache::store(int face, int lod, int x, int y, const std::vector<uchar>& heightData, const std::vector<uchar>& normalData) const {
+    if (!mWritable) return false;
+
+    String path = getTilePath(face, lod, x, y);
+    String temp = path + ".tmp";
+    {
+        std::ofstream stream(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!stream) return false;
+
+        uint32 header[2] = { TILE_MAGIC, TILE_VERSION };
+        stream.write((const char*)header, sizeof(header));
+        writeImage(stream, heightData);
+        writeImage(stream, normalData);
+        if (!stream) {
+            stream.close();
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    return replaceFile(temp, path);
+}
+
+void PlanetTileCache::addStored() {
+    mStored++;
+}
+
+/**
+ * Merge the loose tiles and the existing pack into a new pack, then remove the loose files.
+ * Unmaps the old pack, so no mapped tiles may still be in use.
+ */
+bool PlanetTileCache::pack() {
+    if (!mWritable) return false;
+
+    std::vector<String> files;
+    if (!listTiles(mDirectory, files)) return false;
+    if (files.empty()) return true;
+
+    PlanetTilePack::Writer writer;
+    if (!writer.open(mPackPath)) return false;
+
+    // Loose tiles are newer, so they go in first and win over the pack's copies.
+    for (std::vector<String>::iterator it = files.begin(); it != files.end(); ++it) {
+        int face, lod, x, y;
+        if (sscanf(it->c_str(), "%d_%d_%d_%d.tile", &face, &lod, &x, &y) != 4) continue;
+
+        Image heightImage, normalImage;
+        if (!loadFile(mDirectory + "/" + *it, heightImage, normalImage)) continue;
+        bool written = writer.add(face, lod, x, y, heightImage, normalImage);
+        OGRE_FREE(heightImage.getData(), MEMCATEGORY_GENERAL);
+        OGRE_FREE(normalImage.getData(), MEMCATEGORY_GENERAL);
+        if (!written) return false;
+    }
+    for (size_t i = 0; i < mPack.getTileCount(); ++i) {
+        int face, lod, x, y;
+        Image heightImage, normalImage;
+        mPack.getTile(i, face, lod, x, y, heightImage, normalImage);
+        if (!writer.add(face, lod, x, y, heightImage, normalImage)) return false;
+    }
+
+    mPack.close();
+    bool packed = writer.close();
+    if (packed) {
+        for (std::vector<String>::iterator it = files.begin(); it != files.end(); ++it) {
+            remove((mDirectory + "/" + *it).c_str());
+        }
+        mStored = 0;
+    }
+    mPack.open(mPackPath);
+    return packed;
+}
+
+/**
+ * Images are stored as their byte count, followed by PlanetHalfCodec data.
+ */
+bool PlanetTileCache::readImage(std::istream& stream, Image& image) {
+    uint32 size;
+    stream.read((char*)&size, sizeof(size));
+    if (!stream || size > (64 << 20)) return false;
+
+    std::vector<uchar> data(size);
+    stream.read((char*)&data[0], size);
+    if (!stream) return false;
+    return PlanetHalfCodec::decode(&data[0], size, image);
+}
+
+void PlanetTileCache::writeImage(std::ostream& stream, const std::vector<uchar>& data) {
+    uint32 size = data.size();
+    stream.write((const char*)&size, sizeof(size));
+    stream.write((const char*)&data[0], size);
+}
+
+};
@@ -0,0 +1,70 @@
+/*
+ *  PlanetTileCache.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetTileCache_H
+#define PlanetTileCache_H
+
+#include <Ogre/Ogre.h>
+
+#include "PlanetDescriptor.h"
+#include "PlanetTilePack.h"
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * On-disk cache of finished map tiles (height and normal images).
+     *
+     * Tiles for one planet live in their own directory, named after a hash of everything
+     * that affects their contents: the descriptor's terrain fields plus the map settings the
+     * caller passes in. Changing any of them points at a fresh directory, so stale tiles are
+     * never read. New tiles are stored as loose files, one per tile address, with a small
+     * header to reject truncated or foreign files. Their images are compressed with
+     * PlanetHalfCodec.
+     *
+     * pack() folds the loose files into a single memory-mapped PlanetTilePack next to the
+     * directory. Packs stay uncompressed, so tiles found in the pack are returned without
+     * decoding or copying (mapped = true): don't free them, and don't keep them past pack()
+     * or the cache's lifetime.
+     */
+    class PlanetTileCache {
+    public:
+        PlanetTileCache(const String& path, const PlanetDescriptor& descriptor, const String& settings);
+        ~PlanetTileCache();
+
+        bool load(int face, int lod, int x, int y, Image& heightImage, Image& normalImage, bool& mapped);
+        bool store(int face, int lod, int x, int y, const std::vector<uchar>& heightData, const std::vector<uchar>& normalData) const;
+        void addStored();
+        bool pack();
+
+        const String& getDirectory() const;
+        int getStoredCount() const;
+
+        static uint64 hash(const PlanetDescriptor& descriptor, const String& settings);
+        static String getSettings(const String& backend, int textureSize, bool upsample);
+        static String getPackPath(const String& path, const PlanetDescriptor& descriptor, const String& settings);
+
+    protected:
+        static String getKey(const PlanetDescriptor& descriptor, const String& settings);
+        String getTilePath(int face, int lod, int x, int y) const;
+        static bool loadFile(const String& path, Image& heightImage, Image& normalImage);
+        static bool readImage(std::istream& stream, Image& image);
+        static void writeImage(std::ostream& stream, const std::vector<uchar>& data);
+
+        String mDirectory;
+        bool mWritable;
+        int mStored;
+
+        String mPackPath;
+        PlanetTilePack mPack;
+    };
+
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  PlanetTileMemoryCache.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetTileMemoryCache.h"
+
+#include "Planet.h"
+#include "PlanetHalfCodec.h"
+#include "PlanetTilePack.h"
+
+namespace NFSpace {
+
+PlanetTileMemoryCache::PlanetTileMemoryCache(size_t budget) : mUsage(0), mBudget(budget) {
+}
+
+PlanetTileMemoryCache::~PlanetTileMemoryCache() {
+    while (!mEntries.empty()) {
+        drop(mEntries.begin());
+    }
+}
+
+uint64 PlanetTileMemoryCache::getKey(int face, int lod, int x, int y) {
+    return ((uint64)face << 61) | ((uint64)lod << 56) | PlanetTilePack::morton(x, y);
+}
+
+/**
+ * Decode a tile if it's held. The images are allocated with OGRE_ALLOC_T and owned by the caller.
+ */
+bool PlanetTileMemoryCache::load(int face, int lod, int x, int y, Image& heightImage, Image& normalImage) {
+    EntryMap::iterator it = mEntries.find(getKey(face, lod, x, y));
+    if (it == mEntries.end()) return false;
+
+    Entry& entry = it->second;
+    if (!PlanetHalfCodec::decode(&entry.mHeightData[0], entry.mHeightData.size(), heightImage)) {
+        drop(it);
+        return false;
+    }
+    if (!PlanetHalfCodec::decode(&entry.mNormalData[0], entry.mNormalData.size(), normalImage)) {
+        OGRE_FREE(heightImage.getData(), MEMCATEGORY_GENERAL);
+        heightImage = Image();
+        drop(it);
+        return false;
+    }
+
+    // Kept, so the tile doesn't need encoding again when it's evicted next.
+    mOrder.splice(mOrder.begin(), mOrder, entry.mSlot);
+    return true;
+}
+
+/**
+ * Keep a tile encoded with PlanetHalfCodec, replacing any held copy. Takes the data by
+ * swapping it out of the vectors.
+ */
+void PlanetTileMemoryCache::store(int face, int lod, int x, int y, std::vector<uchar>& heightData, std::vector<uchar>& normalData) {
+    if (!mBudget) return;
+
+    uint64 key = getKey(face, lod, x, y);
+    EntryMap::iterator it = mEntries.find(key);
+    if (it != mEntries.end()) {
+        drop(it);
+    }
+
+    Entry& entry = mEntries[key];
+    entry.mHeightData.swap(heightData);
+    entry.mNormalData.swap(normalData);
+    entry.mSlot = mOrder.insert(mOrder.begin(), key);
+
+    size_t bytes = entry.mHeightData.size() + entry.mNormalData.size();
+    mUsage += bytes;
+    PlanetStats::retainedTiles++;
+    PlanetStats::retainedMemoryUsage += bytes;
+
+    evict();
+}
+
+size_t PlanetTileMemoryCache::getUsage() const {
+    return mUsage;
+}
+
+size_t PlanetTileMemoryCache::getCount() const {
+    return mEntries.size();
+}
+
+void PlanetTileMemoryCache::evict() {
+    while (mUsage > mBudget && !mOrder.empty()) {
+        drop(mEntries.find(mOrder.back()));
+    }
+}
+
+void PlanetTileMemoryCache::drop(EntryMap::iterator it) {
+    Entry& entry = it->second;
+    size_t bytes = entry.mHeightData.size() + entry.mNormalData.size();
+    mUsage -= bytes;
+    PlanetStats::retainedTiles--;
+    PlanetStats::retainedMemoryUsage -= bytes;
+
+    mOrder.erase(entry.mSlot);
+    mEntries.erase(it);
+}
+
+};
@@ -0,0 +1,63 @@
+/*
+ *  PlanetTileMemoryCache.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetTileMemoryCache_H
+#define PlanetTileMemoryCache_H
+
+#include <Ogre/Ogre.h>
+#include <list>
+#include <map>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * In-memory tier of finished map tiles, compressed with PlanetHalfCodec.
+     *
+     * Sits between the resident tiles and regeneration (or the disk cache): when a node gets
+     * a tile it had before it was paged out or merged away, restoring it is a decode and an
+     * upload. Holds at most a byte budget of compressed tiles, dropping the least recently
+     * stored or restored ones first.
+     */
+    class PlanetTileMemoryCache {
+    public:
+        PlanetTileMemoryCache(size_t budget);
+        ~PlanetTileMemoryCache();
+
+        bool load(int face, int lod, int x, int y, Image& heightImage, Image& normalImage);
+        void store(int face, int lod, int x, int y, std::vector<uchar>& heightData, std::vector<uchar>& normalData);
+
+        size_t getUsage() const;
+        size_t getCount() const;
+
+    protected:
+        typedef std::list<uint64> KeyList;
+
+        struct Entry {
+            std::vector<uchar> mHeightData;
+            std::vector<uchar> mNormalData;
+            KeyList::iterator mSlot;
+        };
+        typedef std::map<uint64, Entry> EntryMap;
+
+        static uint64 getKey(int face, int lod, int x, int y);
+        void evict();
+        void drop(EntryMap::iterator it);
+
+        EntryMap mEntries;
+        // Most recently used first.
+        KeyList mOrder;
+        size_t mUsage;
+        size_t mBudget;
+    };
+
+};
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ *  PlanetTilePack.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetTilePack.h"
+#include "Utility.h"
+
+#include <algorithm>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NFSpace {
+
+namespace {
+    // Bump when the layout changes.
+    const uint32 PACK_MAGIC = 0x4B50464E; // "NFPK"
+    const uint32 PACK_VERSION = 1;
+
+    /**
+     * Map a whole file read-only. The mapping stays valid after the file is closed.
+     */
+    void* mapFile(const String& path, size_t& size) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) return 0;
+
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0 || (uint64)length.QuadPart > (size_t)-1) {
+            CloseHandle(file);
+            return 0;
+        }
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(file);
+        if (!mapping) return 0;
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        size = (size_t)length.QuadPart;
+        return data;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) return 0;
+
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0) {
+            ::close(file);
+            return 0;
+        }
+
+        void* data = mmap(0, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (data == MAP_FAILED) return 0;
+        size = info.st_size;
+        return data;
+#endif
+    }
+
+    void unmapFile(void* data, size_t size) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+    }
+}
+
+const size_t PlanetTilePack::PAGE_SIZE = 4096;
+
+PlanetTilePack::PlanetTilePack() : mData(0), mSize(0), mIndex(0), mTileCount(0) {
+}
+
+PlanetTilePack::~PlanetTilePack() {
+    close();
+}
+
+/**
+ * Map a pack file. Returns false if it's missing or not a valid pack.
+ */
+bool PlanetTilePack::open(const String& path) {
+    close();
+
+    size_t size;
+    void* data = mapFile(path, size);
+    if (!data) return false;
+
+    mData = (uchar*)data;
+    mSize = size;
+
+    const Header* header = (const Header*)mData;
+    if (mSize < sizeof(Header) ||
+        header->mMagic != PACK_MAGIC || header->mVersion != PACK_VERSION ||
+        header->mIndexOffset > mSize ||
+        header->mTileCount > (mSize - header->mIndexOffset) / sizeof(Entry)) {
+        close();
+        return false;
+    }
+    mIndex = (const Entry*)(mData + header->mIndexOffset);
+    mTileCount = header->mTileCount;
+    return true;
+}
+
+void PlanetTilePack::close() {
+    if (mData) {
+        unmapFile(mData, mSize);
+    }
+    mData = 0;
+    mSize = 0;
+    mIndex = 0;
+    mTileCount = 0;
+}
+
+bool PlanetTilePack::isOpen() const {
+    return mData != 0;
+}
+
+size_t PlanetTilePack::getTileCount() const {
+    return mTileCount;
+}
+
+/**
+ * Look up a tile. The images point into the mapping, see class comment.
+ */
+bool PlanetTilePack::find(int face, int lod, int x, int y, Image& heightImage, Image& normalImage) const {
+    if (!mData) return false;
+
+    Entry key;
+    key.mFace = face;
+    key.mLOD = lod;
+    key.mMorton = morton(x, y);
+
+    const Entry* end = mIndex + mTileCount;
+    const Entry* entry = std::lower_bound(mIndex, end, key, before);
+    if (entry == end || before(key, *entry)) return false;
+
+    return wrap(entry->mHeightMap, heightImage) && wrap(entry->mNormalMap, normalImage);
+}
+
+/**
+ * Tile by index order, for copying a pack.
+ */
+void PlanetTilePack::getTile(size_t index, int& face, int& lod, int& x, int& y, Image& heightImage, Image& normalImage) const {
+    assert(index < mTileCount);
+    const Entry& entry = mIndex[index];
+    face = entry.mFace;
+    lod = entry.mLOD;
+    unmorton(entry.mMorton, x, y);
+    wrap(entry.mHeightMap, heightImage);
+    wrap(entry.mNormalMap, normalImage);
+}
+
+bool PlanetTilePack::before(const Entry& a, const Entry& b) {
+    if (a.mFace != b.mFace) return a.mFace < b.mFace;
+    if (a.mLOD != b.mLOD) return a.mLOD < b.mLOD;
+    return a.mMorton < b.mMorton;
+}
+
+bool PlanetTilePack::wrap(const Payload& payload, Image& image) const {
+    PixelFormat format = (PixelFormat)payload.mFormat;
+    if (format == PF_UNKNOWN || format >= PF_COUNT) return false;
+
+    size_t size = PixelUtil::getMemorySize(payload.mWidth, payload.mHeight, 1, format);
+    if (payload.mOffset > mSize || size > mSize - payload.mOffset) return false;
+
+    // Read-only mapping: Image wants a non-const pointer, but must never write through it.
+    image.loadDynamicImage(mData + payload.mOffset, payload.mWidth, payload.mHeight, 1, format, false, 1, 0);
+    return true;
+}
+
+/**
+ * Interleave the bits of x and y, so nearby tiles sort near each other.
+ */
+uint64 PlanetTilePack::morton(int x, int y) {
+    uint64 code = 0;
+    for (int i = 0; i < 32; ++i) {
+        code |= (uint64)((x >> i) & 1) << (2 * i);
+        code |= (uint64)((y >> i) & 1) << (2 * i + 1);
+    }
+    return code;
+}
+
+void PlanetTilePack::unmorton(uint64 code, int& x, int& y) {
+    x = y = 0;
+    for (int i = 0; i < 32; ++i) {
+        x |= (int)((code >> (2 * i)) & 1) << i;
+        y |= (int)((code >> (2 * i + 1)) & 1) << i;
+    }
+}
+
+PlanetTilePack::Writer::Writer() : mOffset(0) {
+}
+
+PlanetTilePack::Writer::~Writer() {
+    // Abandon an unfinished pack.
+    if (mStream.is_open()) {
+        mStream.close();
+        remove(mTempPath.c_str());
+    }
+}
+
+bool PlanetTilePack::Writer::open(const String& path) {
+    mPath = path;
+    mTempPath = path + ".tmp";
+    mStream.open(mTempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!mStream) return false;
+
+    // Header gets filled in on close, payloads start on the next page.
+    std::vector<char> padding(PAGE_SIZE, 0);
+    mStream.write(&padding[0], PAGE_SIZE);
+    mOffset = PAGE_SIZE;
+    return !!mStream;
+}
+
+/**
+ * Add a tile, unless the pack already has one at this address. Returns false on write errors.
+ */
+bool PlanetTilePack::Writer::add(int face, int lod, int x, int y, const Image& heightImage, const Image& normalImage) {
+    Entry entry;
+    entry.mFace = face;
+    entry.mLOD = lod;
+    entry.mMorton = morton(x, y);
+    if (!mKeys.insert(std::make_pair(((uint64)face << 32) | (uint32)lod, entry.mMorton)).second) {
+        return true;
+    }
+
+    if (!writePayload(heightImage, entry.mHeightMap) || !writePayload(normalImage, entry.mNormalMap)) {
+        return false;
+    }
+    mIndex.push_back(entry);
+    return true;
+}
+
+bool PlanetTilePack::Writer::writePayload(const Image& image, Payload& payload) {
+    payload.mOffset = mOffset;
+    payload.mFormat = image.getFormat();
+    payload.mWidth = image.getWidth();
+    payload.mHeight = image.getHeight();
+    payload.mReserved = 0;
+
+    size_t size = image.getSize();
+    mStream.write((const char*)image.getData(), size);
+
+    // Pad to the next page.
+    size_t padded = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    std::vector<char> padding(padded - size, 0);
+    if (!padding.empty()) {
+        mStream.write(&padding[0], padding.size());
+    }
+    mOffset += padded;
+    return !!mStream;
+}
+
+/**
+ * Size of the pack so far, including its index.
+ */
+uint64 PlanetTilePack::Writer::getSize() const {
+    return mOffset + mIndex.size() * sizeof(Entry);
+}
+
+/**
+ * Write the index and header, and move the pack into place.
+ */
+bool PlanetTilePack::Writer::close() {
+    std::sort(mIndex.begin(), mIndex.end(), PlanetTilePack::before);
+
+    Header header;
+    header.mMagic = PACK_MAGIC;
+    header.mVersion = PACK_VERSION;
+    header.mTileCount = mIndex.size();
+    header.mReserved = 0;
+    header.mIndexOffset = mOffset;
+
+    if (!mIndex.empty()) {
+        mStream.write((const char*)&mIndex[0], mIndex.size() * sizeof(Entry));
+    }
+    mStream.seekp(0);
+    mStream.write((const char*)&header, sizeof(header));
+    mStream.close();
+
+    if (mStream.fail() || !replaceFile(mTempPath, mPath)) {
+        remove(mTempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+};
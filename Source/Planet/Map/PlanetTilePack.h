@@ -0,0 +1,113 @@
+/*
+ *  PlanetTilePack.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetTilePack_H
+#define PlanetTilePack_H
+
+#include <Ogre/Ogre.h>
+#include <fstream>
+#include <set>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+    /**
+     * Read-only, memory-mapped pack of map tiles (height and normal images) for one planet.
+     *
+     * Layout: a header, the tile payloads, each starting on a 4 KB boundary, and an index
+     * sorted by (face, lod, morton(x, y)) that the header points to. Lookups are a binary
+     * search over the index. Images returned by find() point straight into the mapping, so
+     * loading a tile costs page faults rather than reads, and the kernel's page cache decides
+     * what stays resident. Those images must not be written to or freed, and must not outlive
+     * the pack.
+     *
+     * Packs are in host byte order; they're a cache, not an interchange format.
+     */
+    class PlanetTilePack {
+    public:
+        static const size_t PAGE_SIZE;
+
+        PlanetTilePack();
+        ~PlanetTilePack();
+
+        bool open(const String& path);
+        void close();
+        bool isOpen() const;
+
+        size_t getTileCount() const;
+        bool find(int face, int lod, int x, int y, Image& heightImage, Image& normalImage) const;
+        void getTile(size_t index, int& face, int& lod, int& x, int& y, Image& heightImage, Image& normalImage) const;
+
+        static uint64 morton(int x, int y);
+        static void unmorton(uint64 code, int& x, int& y);
+
+    protected:
+        struct Header {
+            uint32 mMagic;
+            uint32 mVersion;
+            uint32 mTileCount;
+            uint32 mReserved;
+            uint64 mIndexOffset;
+        };
+
+        struct Payload {
+            uint64 mOffset;
+            uint32 mFormat;
+            uint32 mWidth;
+            uint32 mHeight;
+            uint32 mReserved;
+        };
+
+        struct Entry {
+            uint32 mFace;
+            uint32 mLOD;
+            uint64 mMorton;
+            Payload mHeightMap;
+            Payload mNormalMap;
+        };
+
+        static bool before(const Entry& a, const Entry& b);
+        bool wrap(const Payload& payload, Image& image) const;
+
+        uchar* mData;
+        size_t mSize;
+        const Entry* mIndex;
+        size_t mTileCount;
+
+    public:
+        /**
+         * Writes a new pack. Payloads are streamed out as they're added, the index is sorted
+         * and written by close(). The pack only replaces the file at path once it's complete.
+         */
+        class Writer {
+        public:
+            Writer();
+            ~Writer();
+
+            bool open(const String& path);
+            bool add(int face, int lod, int x, int y, const Image& heightImage, const Image& normalImage);
+            bool close();
+            uint64 getSize() const;
+
+        protected:
+            bool writePayload(const Image& image, Payload& payload);
+
+            String mPath;
+            String mTempPath;
+            std::ofstream mStream;
+            uint64 mOffset;
+            std::vector<Entry> mIndex;
+            std::set<std::pair<uint64, uint64> > mKeys;
+        };
+    };
+
+};
+
+#endif
@@ -11,15 +11,21 @@
 
 #include "EngineState.h"
 
+#include <algorithm>
+
 using namespace Ogre;
 
 namespace NFSpace {
     
 PlanetCube::PlanetCube(MovableObject* proxy, PlanetMap* map)
-: mProxy(proxy), mLODCamera(0), mMap(map), mFrameCounter(0) {
+: mProxy(proxy), mMap(map), mLODCamera(0), mPrefetch(false), mLastCameraPosition(Vector3::ZERO), mCameraVelocity(Vector3::ZERO), mLastCameraTime(0),
+  mFrameCounter(0), mPagerBudget(0), mPagerReserve(0), mPagerTime(0), mPagerDebt(0), mPagerStepCost(0) {
     for (int i = 0; i < 6; ++i) {
         initFace(i);
     }
+    for (int i = 0; i < 4; ++i) {
+        mPagerCost[i] = 0;
+    }
 
     mTimer = OGRE_NEW Timer();
 
@@ -87,86 +93,275 @@ void PlanetCube::mergeQuadTreeNode(QuadTreeNode* node) {
 
 void PlanetCube::request(QuadTreeNode* node, int type, bool priority) {
     RequestQueue& requestQueue = (type == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
-    if (priority) {
-        requestQueue.push_front(Request(node, type));
-    }
-    else {
-        requestQueue.push_back(Request(node, type));
+    requestQueue.push(node, type, priority);
+}
+
+void PlanetCube::prefetchRequest(QuadTreeNode* node, int type) {
+    RequestQueue& requestQueue = (type == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
+    requestQueue.prefetch(node, type);
+}
+
+void PlanetCube::confirmRequest(QuadTreeNode* node, int type) {
+    RequestQueue& requestQueue = (type == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
+    requestQueue.confirm(node, type);
+}
+
+/**
+ * Cancel map tiles that traversal hasn't asked for in planet.requestTimeout frames, e.g.
+ * because the camera moved on. Partially built tiles are released.
+ */
+void PlanetCube::dropStaleRequests() {
+    int timeout = getInt("planet.requestTimeout");
+    if (timeout <= 0) return;
+
+    vector<RequestQueue::Request> stale;
+    mRenderRequests.getStale(mFrameCounter - timeout, stale);
+    for (vector<RequestQueue::Request>::iterator it = stale.begin(); it != stale.end(); ++it) {
+        QuadTreeNode* node = it->mNode;
+#ifdef NF_DEBUG_TREEMGT
+        printf("dropStale (f%d @ %d - %d, %d) - queued %d frames ago\n",
+               node->mFace, node->mLOD, node->mX, node->mY, mFrameCounter - it->mEnqueued);
+#endif
+        mRenderRequests.remove(node, REQUEST_MAPTILE);
+        mMap->resetTile(node);
+        node->mRequestMapTile = false;
+        wake(node, REQUEST_MAPTILE);
+
+        // Let traversal ask again for a renderable that was waiting on this tile.
+        if (!node->mRenderable) {
+            node->mRequestRenderable = false;
+        }
+        PlanetStats::droppedTiles++;
     }
 }
 
 void PlanetCube::unrequest(QuadTreeNode* node) {
-    RequestQueue* requestQueues[] = { &mRenderRequests, &mInlineRequests };
-    for (int q = 0; q < 2; q++) {
-        RequestQueue::iterator i = (*requestQueues[q]).begin(), j;
-        while (i != (*requestQueues[q]).end()) {
-            if ((*i).mNode == node) {
-                // Remove item at front of queue.
-                if (i == (*requestQueues[q]).begin()) {
-                    // Special case: if unrequesting a maptile current being generated,
-                    // make sure temp/unclaimed resources are cleaned up.
-                    if ((*i).mType == REQUEST_MAPTILE) {
-                        mMap->resetTile();
-                    }
-
-                    (*requestQueues[q]).erase(i);
-                    i = (*requestQueues[q]).begin();
-                    continue;
-                }
-                // Remove item mid-queue.
-                else {
-                    j = i;
-                    --i;
-                    (*requestQueues[q]).erase(j);
-                }
-            }
-            ++i;
+    // If unrequesting a maptile being generated,
+    // make sure temp/unclaimed resources are cleaned up.
+    if (mRenderRequests.remove(node, REQUEST_MAPTILE)) {
+        mMap->resetTile(node);
+    }
+    mInlineRequests.remove(node, REQUEST_RENDERABLE);
+    mInlineRequests.remove(node, REQUEST_SPLIT);
+    mInlineRequests.remove(node, REQUEST_MERGE);
+
+    // Cut this node out of the task graph. Anything waiting on it gets to re-evaluate.
+    for (int type = 0; type < 4; ++type) {
+        unlink(node, type);
+        wake(node, type);
+    }
+}
+
+/**
+ * Refresh the cached priority of a node's queued requests.
+ */
+void PlanetCube::updatePriority(QuadTreeNode* node) {
+    for (int type = 0; type < 4; ++type) {
+        RequestQueue& requestQueue = (type == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
+        requestQueue.update(node, type);
+    }
+}
+
+/**
+ * A node's request completed. Refresh the priorities it can have changed: the node's own,
+ * its children's (inherited until they get a renderable) and those of requests waiting on it.
+ */
+void PlanetCube::reprioritize(QuadTreeNode* node) {
+    updatePriority(node);
+    for (int i = 0; i < 4; ++i) {
+        if (node->mChildren[i]) {
+            updatePriority(node->mChildren[i]);
         }
     }
+    for (std::vector<QuadTreeNode::Dependent>::iterator it = node->mDependents.begin(); it != node->mDependents.end(); ++it) {
+        updatePriority(it->mNode);
+    }
+}
+
+/**
+ * Queue a request that continues once another request is done. Without a node to wait
+ * on, the request waits until woken directly (e.g. by the map's workers).
+ */
+void PlanetCube::waitFor(QuadTreeNode* node, int type, QuadTreeNode* on, int onType, bool prefetch) {
+    RequestQueue& requestQueue = (type == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
+    requestQueue.block(node, type, prefetch);
+
+    unlink(node, type);
+    if (on) {
+        QuadTreeNode::Dependent dependent;
+        dependent.mNode = node;
+        dependent.mType = type;
+        dependent.mOnType = onType;
+        on->mDependents.push_back(dependent);
+        node->mBlockedOn[type] = on;
+    }
+}
+
+/**
+ * A request completed or went away: unblock everything waiting on it.
+ */
+void PlanetCube::wake(QuadTreeNode* on, int onType) {
+    std::vector<QuadTreeNode::Dependent>::iterator it = on->mDependents.begin();
+    while (it != on->mDependents.end()) {
+        if (it->mOnType != onType) {
+            ++it;
+            continue;
+        }
+        QuadTreeNode::Dependent dependent = *it;
+        it = on->mDependents.erase(it);
+
+        dependent.mNode->mBlockedOn[dependent.mType] = 0;
+        RequestQueue& requestQueue = (dependent.mType == REQUEST_MAPTILE) ? mRenderRequests : mInlineRequests;
+        requestQueue.unblock(dependent.mNode, dependent.mType);
+    }
+}
+
+/**
+ * Remove the edge from a node's request to whatever it was waiting on.
+ */
+void PlanetCube::unlink(QuadTreeNode* node, int type) {
+    QuadTreeNode* on = node->mBlockedOn[type];
+    if (!on) return;
+    node->mBlockedOn[type] = 0;
+
+    std::vector<QuadTreeNode::Dependent>& dependents = on->mDependents;
+    for (std::vector<QuadTreeNode::Dependent>::iterator it = dependents.begin(); it != dependents.end(); ++it) {
+        if (it->mNode == node && it->mType == type) {
+            dependents.erase(it);
+            return;
+        }
+    }
+}
+
+/**
+ * Resume map tile requests whose tiles the workers finished.
+ */
+void PlanetCube::wakeFinishedTiles() {
+    vector<QuadTreeNode*> finished;
+    mMap->collectTiles(finished);
+    for (vector<QuadTreeNode*>::iterator it = finished.begin(); it != finished.end(); ++it) {
+        mRenderRequests.unblock(*it, REQUEST_MAPTILE);
+    }
 }
     
+/**
+ * Map tile requests and GPU steps leave the reserved part of the slot to the inline requests.
+ */
 void PlanetCube::handleRenderRequests() {
-    handleRequests(mRenderRequests);
+    wakeFinishedTiles();
+    handleRequests(mRenderRequests, mPagerBudget - mPagerReserve);
+    handleMapSteps(mPagerBudget - mPagerReserve);
 }
 
 void PlanetCube::handleInlineRequests() {
-    handleRequests(mInlineRequests);
+    handleRequests(mInlineRequests, mPagerBudget);
 }
 
-void PlanetCube::handleRequests(RequestQueue& requests) {
+/**
+ * Start a new frame's pager time slot. Time spent over last frame's slot is paid back
+ * here, up to one full slot, so a single slow job can't stall the pager for long.
+ */
+void PlanetCube::beginPagerFrame() {
+    mRenderRequests.setFrame(mFrameCounter);
+    mInlineRequests.setFrame(mFrameCounter);
+
+    Real slot = getReal("planet.pagerTimeSlot") * 1000.0f;
+    mPagerBudget = slot - minf(mPagerDebt, slot);
+    mPagerReserve = mPagerBudget * maxf(0, minf(1, getReal("planet.pagerInlineShare")));
+    mPagerTime = 0;
+}
 
-    // Ensure we only use up x time per frame.
-    int weights[] = { 10, 10, 1, 2 };
+void PlanetCube::endPagerFrame() {
+    mPagerDebt = maxf(0, mPagerTime - mPagerBudget);
+    if (mPagerDebt > 0) {
+        PlanetStats::pagerOverruns++;
+    }
+    PlanetStats::pagerTime = (int)mPagerTime;
+}
+
+/**
+ * Advance the map tiles in flight with what's left of the budget. At least one step
+ * runs every frame, so requests can't starve the pipeline. Finished tiles are picked up
+ * by wakeFinishedTiles() next frame.
+ */
+void PlanetCube::handleMapSteps(Real budget) {
+    for (int steps = 0; ; ++steps) {
+        Real remaining = budget - mPagerTime;
+        if (steps > 0 && (remaining <= 0 || mPagerStepCost > remaining)) break;
+
+        unsigned long start = mTimer->getMicroseconds();
+        if (!mMap->stepTiles()) break;
+        Real elapsed = mTimer->getMicroseconds() - start;
+        mPagerTime += elapsed;
+        mPagerStepCost += (elapsed - mPagerStepCost) * 0.25f;
+    }
+}
+
+/**
+ * Run requests until the frame's pager time reaches budget. The first request always runs,
+ * so neither queue can be starved by the other.
+ */
+void PlanetCube::handleRequests(RequestQueue& requests, Real budget) {
+
+    // Ensure we only use up planet.pagerTimeSlot ms per frame, as measured.
     bool(PlanetCube::*handlers[4])(QuadTreeNode*) = {
         &PlanetCube::handleRenderable,
         &PlanetCube::handleMapTile,
         &PlanetCube::handleSplit,
         &PlanetCube::handleMerge
     };
-    int limit = 10;
-    bool sorted = false;
+    bool deferred = false;
+    int handled = 0;
     
-    while (requests.size() > 0) {
-        Request request = *requests.begin();
-        QuadTreeNode* node = request.mNode;
+    while (!requests.empty()) {
+        const RequestQueue::Request& request = requests.top();
+        // Everything left is waiting on something else.
+        if (request.mDeferred || request.mBlocked) break;
 
-        // If not a root level task.
-        if (node->mParent) {
-            // Verify job limits.
-            if (limit <= 0) return;
-            limit -= weights[request.mType];
+        QuadTreeNode* node = request.mNode;
+        int type = request.mType;
+        bool prefetch = request.mPrefetch;
+
+        // If not a root level task, nor the first from this queue this frame.
+        if (node->mParent && handled > 0) {
+            // Verify time budget. Leftover requests stay queued for the next frame.
+            Real remaining = budget - mPagerTime;
+            if (remaining <= 0) break;
+            // Don't start a job that probably won't fit.
+            if (mPagerCost[type] > remaining) break;
         }
         
-        requests.pop_front();
-        // Call handler.
-        if ((this->*handlers[request.mType])(node)) {
-            // Job was completed. We can re-sort the priority queue.
-            if (!sorted) {
-                requests.sort(RequestComparePriority());
-                sorted = true;
-            }
+        requests.pop();
+        handled++;
+        // Call handler, and keep a running average of its cost.
+        unsigned long start = mTimer->getMicroseconds();
+        bool done = (this->*handlers[type])(node);
+        Real elapsed = mTimer->getMicroseconds() - start;
+        mPagerTime += elapsed;
+        mPagerCost[type] += (elapsed - mPagerCost[type]) * 0.25f;
+
+        if (done) {
+            // Job was completed. Refresh the priorities it affects.
+            reprioritize(node);
+        }
+        else if (mMap->isTilePending(node)) {
+            // Building in the background. Sleep until the workers or pipeline are done with it.
+            waitFor(node, type, 0, 0, prefetch);
+        }
+        else if (mMap->isAsync()) {
+            // Worker queue or pipeline is full, let other requests go first.
+            requests.defer(node, type, prefetch);
+            deferred = true;
+        }
+        else {
+            // Needs more work, keep at it.
+            requests.push(node, type, true);
         }
     }
+
+    if (deferred) {
+        requests.undefer();
+    }
 }
     
 bool PlanetCube::handleRenderable(QuadTreeNode* node) {
@@ -200,10 +395,16 @@ bool PlanetCube::handleRenderable(QuadTreeNode* node) {
     }
     
     // If no renderable was created, try creating a map tile.
-    if (node->mRequestRenderable && !node->mMapTile && !node->mRequestMapTile) {
-        // Request a map tile for this node's LOD level.
-        node->mRequestMapTile = true;
-        request(node, REQUEST_MAPTILE, true);
+    if (node->mRequestRenderable && !node->mMapTile) {
+        if (!node->mRequestMapTile) {
+            // Request a map tile for this node's LOD level.
+            node->mRequestMapTile = true;
+            request(node, REQUEST_MAPTILE, true);
+        }
+        // Continue once it's in.
+        if (node->mRequestSlot[REQUEST_MAPTILE] >= 0) {
+            waitFor(node, REQUEST_RENDERABLE, node, REQUEST_MAPTILE);
+        }
     }
     return true;
 }
@@ -215,8 +416,7 @@ bool PlanetCube::handleMapTile(QuadTreeNode* node) {
 
     // See if the map tile object for this node is ready yet.
     if (!node->prepareMapTile(mMap)) {
-        // Needs more work.
-        request(node, REQUEST_MAPTILE, true);
+        // Needs more work, handleRequests requeues it.
         return false;
     }
     else {
@@ -224,7 +424,8 @@ bool PlanetCube::handleMapTile(QuadTreeNode* node) {
         node->createMapTile(mMap);
         node->mRequestMapTile = false;
 
-        // Request a new renderable to match.
+        // Wake whatever was waiting on the tile, and request a new renderable to match.
+        wake(node, REQUEST_MAPTILE);
         node->mRequestRenderable = true;
         request(node, REQUEST_RENDERABLE, true);
 
@@ -281,6 +482,10 @@ void PlanetCube::refreshMapTile(QuadTreeNode* node, PlanetMapTile* tile) {
     }
 }
 
+/**
+ * Merge the least recently opened node whose children have gone too detailed for the camera.
+ * Runs whatever the memory use, see evictTiles() for merging and paging out over budget.
+ */
 void PlanetCube::pruneTree() {
     NodeHeap heap;
     
@@ -299,28 +504,116 @@ void PlanetCube::pruneTree() {
                 (oldNode->mRenderable->isInLODRange() && oldNode->mRenderable->isInMIPRange())
                ) {
                 oldNode->mRequestMerge = true;
-                //handleMerge(oldNode);
                 request(oldNode, REQUEST_MERGE, TRUE);
                 return;
             }
             else {
                 oldNode->mLastOpened = getFrameCounter();
             }
-
-#ifdef NF_DEBUG_TREEMGT
-            QuadTreeNode* node = oldNode;
-            printf("requestMerge (f%d @ %d - %d, %d) - Vis,LOD,MIP: %d, %d, %d\n",
-                   node->mFace, node->mLOD, node->mX, node->mY,
-                   !node->mRenderable->isClipped(),
-                   node->mRenderable->isInLODRange(),
-                   node->mRenderable->isInMIPRange()//
-                   );
-#endif
         }
         heap.pop();
     }
 }
 
+namespace {
+    // Candidate for PlanetCube::evictTiles: page out a node's tile, or merge its children.
+    struct Eviction {
+        QuadTreeNode* mNode;
+        bool mMerge;
+        size_t mBytes;
+        Real mScore;
+    };
+
+    bool moreValuable(const Eviction& a, const Eviction& b) {
+        return a.mScore > b.mScore;
+    }
+}
+
+/**
+ * Bring map tile and renderable memory back under planet.tileCacheMB.
+ *
+ * Walks the residency from the least recently used entry, up to the ones drawn last frame,
+ * and collects what can go: a leaf, whether it has its own tile or draws from an ancestor's,
+ * by merging its parent once none of the siblings are drawn; or an inner node's tile by
+ * paging it out once its children cover it at least two levels down. Candidates are taken
+ * by bytes freed times frames unused, until the budget is met, skipping any that clash with
+ * one already taken. Entries in use stay, even if that leaves the cube over budget.
+ */
+void PlanetCube::evictTiles() {
+    mResidency.setBudget((size_t)maxi(getInt("planet.tileCacheMB"), 0) << 20);
+    if (!mResidency.isOverBudget()) return;
+
+    size_t usage = mResidency.getUsage();
+    int recent = getFrameCounter() - 1;
+
+    std::vector<Eviction> candidates;
+    NodeSet merging;
+    PlanetTileResidency::EntryList::const_reverse_iterator entry;
+    for (entry = mResidency.oldest(); entry != mResidency.end() && entry->mUsed < recent; ++entry) {
+        QuadTreeNode* node = entry->mNode;
+        QuadTreeNode* parent = node->mParent;
+
+        // Already on its way out.
+        if (parent && parent->mRequestMerge) {
+            usage -= std::min(usage, entry->mBytes);
+            continue;
+        }
+
+        Eviction eviction;
+        eviction.mNode = node;
+        eviction.mScore = (Real)entry->mBytes * (getFrameCounter() - entry->mUsed);
+
+        if (node->mHasChildren) {
+            // Inner tile that only its own, undrawn renderable uses.
+            if (!node->mRenderable || !node->mMapTile || node->mRequestMerge || node->mMapTile->getReferences() != 1 ||
+                node->mLastOpened < recent || node->mRenderLevel <= 1) continue;
+            eviction.mMerge = false;
+            eviction.mBytes = entry->mBytes;
+        }
+        else {
+            // Leaf, goes when its parent merges all four siblings.
+            if (!parent || !mOpenNodes.count(parent) || parent->mPageOut || !parent->mRenderable ||
+                !merging.insert(parent).second) continue;
+
+            bool drawn = false;
+            eviction.mBytes = 0;
+            for (int i = 0; i < 4; ++i) {
+                QuadTreeNode* sibling = parent->mChildren[i];
+                if (sibling->mLastRendered >= recent) drawn = true;
+                if (sibling->mResident) eviction.mBytes += sibling->mResidentSlot->mBytes;
+            }
+            if (drawn) continue;
+            eviction.mNode = parent;
+            eviction.mMerge = true;
+        }
+        candidates.push_back(eviction);
+    }
+
+    // A node is merged or paged out, not both. Nor is a node paged out while its children
+    // merge, or the other way around: the merge would bring its renderable straight back.
+    NodeSet taken;
+    std::sort(candidates.begin(), candidates.end(), moreValuable);
+    for (std::vector<Eviction>::iterator it = candidates.begin(); it != candidates.end() && usage > mResidency.getBudget(); ++it) {
+        QuadTreeNode* node = it->mNode;
+        if (!taken.insert(node).second) continue;
+        if (it->mMerge) {
+            if (node->mParent) taken.insert(node->mParent);
+            node->mRequestMerge = true;
+            request(node, REQUEST_MERGE, true);
+        }
+        else {
+            for (int i = 0; i < 4; ++i) {
+                if (node->mChildren[i]) taken.insert(node->mChildren[i]);
+            }
+            PlanetStats::totalPagedOut++;
+            node->mPageOut = true;
+            node->destroyRenderable();
+            node->destroyMapTile();
+        }
+        usage -= std::min(usage, it->mBytes);
+    }
+}
+
 void PlanetCube::updateRenderQueue(RenderQueue* queue, const Matrix4& fullTransform) {
     // Update LOD state.
     if (mLODCamera && !getBool("planet.lodFreeze")) {
@@ -331,39 +624,139 @@ void PlanetCube::updateRenderQueue(RenderQueue* queue, const Matrix4& fullTransf
         mLOD.mCameraFrustum.setModelViewProjMatrix(mLODCamera->getProjectionMatrix() * viewMatrix * fullTransform);
         mLOD.mCameraFront = Vector3(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
 
-        mLOD.mSpherePlane = mLOD.mCameraPosition;
-        mLOD.mSpherePlane.normalise();
-        
-        Real planetRadius = getReal("planet.radius");
-        Real planetHeight = getReal("planet.height");
-        
-        if (mLOD.mCameraPosition.length() > planetRadius) {
-            mLOD.mSphereClip = cos(
-                            acos((planetRadius + planetHeight / 2) / (planetRadius + planetHeight)) +
-                            acos(planetRadius / mLOD.mCameraPosition.length())
-                        );
-        }
-        else {
-            mLOD.mSphereClip = -1;
-        }
-
+        updateSphereClip(mLOD);
+        updatePrefetch(viewMatrix, fullTransform);
     }
 
     PlanetStats::renderedRenderables = 0;
-    PlanetStats::gpuMemoryUsage = 0;
     PlanetStats::totalOpenNodes = mOpenNodes.size();
     PlanetStats::requestQueue = mInlineRequests.size() + mRenderRequests.size();
 
     for (int i = 0; i < 6; ++i) {
-        PlanetStats::gpuMemoryUsage += mFaces[i]->mRoot->getGPUMemoryUsage();
         if (mFaces[i]->mRoot->willRender()) {
             mFaces[i]->mRoot->render(queue, mLOD);
         }
     }
+
+    if (mPrefetch && !getBool("planet.treeFreeze")) {
+        for (int i = 0; i < 6; ++i) {
+            prefetch(mFaces[i]->mRoot);
+        }
+    }
     
     mFrameCounter++;
 }
     
+void PlanetCube::updateSphereClip(PlanetLODConfiguration& lod) {
+    lod.mSpherePlane = lod.mCameraPosition;
+    lod.mSpherePlane.normalise();
+    
+    Real planetRadius = getReal("planet.radius");
+    Real planetHeight = getReal("planet.height");
+    
+    if (lod.mCameraPosition.length() > planetRadius) {
+        lod.mSphereClip = cos(
+                        acos((planetRadius + planetHeight / 2) / (planetRadius + planetHeight)) +
+                        acos(planetRadius / lod.mCameraPosition.length())
+                    );
+    }
+    else {
+        lod.mSphereClip = -1;
+    }
+}
+
+/**
+ * Track the LOD camera's velocity, and extrapolate it planet.prefetchHorizon seconds ahead.
+ */
+void PlanetCube::updatePrefetch(const Matrix4& viewMatrix, const Matrix4& fullTransform) {
+    unsigned long now = mTimer->getMilliseconds();
+    if (mLastCameraTime && now > mLastCameraTime) {
+        Vector3 velocity = (mLOD.mCameraPosition - mLastCameraPosition) / ((now - mLastCameraTime) * 0.001f);
+        mCameraVelocity += (velocity - mCameraVelocity) * 0.2f;
+    }
+    mLastCameraPosition = mLOD.mCameraPosition;
+    mLastCameraTime = now;
+
+    // Only bother when the camera is going somewhere.
+    Vector3 offset = mCameraVelocity * getReal("planet.prefetchHorizon");
+    Real scale = getScale();
+    mPrefetch = offset.squaredLength() > scale * scale * 1e-6f;
+    if (!mPrefetch) return;
+
+    mPrefetchLOD = mLOD;
+    mPrefetchLOD.mCameraPosition += offset;
+    mPrefetchLOD.mCameraFrustum.setModelViewProjMatrix(mLODCamera->getProjectionMatrix() * viewMatrix * Matrix4::getTrans(-offset) * fullTransform);
+    updateSphereClip(mPrefetchLOD);
+}
+
+/**
+ * Walk the tree as QuadTreeNode::render would for the predicted camera, and queue low
+ * priority map tile, split and renderable requests for what it will need.
+ */
+void PlanetCube::prefetch(QuadTreeNode* node) {
+    if (!node->mRenderable) {
+        // Paged out nodes keep their children.
+        if (node->mPageOut) {
+            for (int i = 0; i < 4; ++i) {
+                if (node->mChildren[i]) prefetch(node->mChildren[i]);
+            }
+        }
+        return;
+    }
+
+    bool clipped, inLODRange, inMIPRange;
+    node->mRenderable->testFrameOfReference(mPrefetchLOD, clipped, inLODRange, inMIPRange);
+    if (clipped) return;
+
+    bool recurse = false;
+    if (!inMIPRange) {
+        if (node->mMapTile) {
+            recurse = node->mRenderable->getMapTile() == node->mMapTile;
+        }
+        else if (node->mRequestMapTile) {
+            confirmRequest(node, REQUEST_MAPTILE);
+        }
+        else if (!isMapTilePending(node)) {
+            node->mRequestMapTile = true;
+            prefetchRequest(node, REQUEST_MAPTILE);
+        }
+    }
+    if ((node->mHasChildren || !node->mRequestMapTile) && !inLODRange) {
+        recurse = true;
+    }
+    if (!recurse) return;
+
+    if (node->mHasChildren) {
+        for (int i = 0; i < 4; ++i) {
+            QuadTreeNode* child = node->mChildren[i];
+            if (!child) continue;
+            if (!child->mRenderable && !child->mPageOut && !child->mRequestRenderable) {
+                child->mRequestRenderable = true;
+                prefetchRequest(child, REQUEST_RENDERABLE);
+            }
+            prefetch(child);
+        }
+    }
+    else if (!node->mRequestSplit) {
+        node->mRequestSplit = true;
+        prefetchRequest(node, REQUEST_SPLIT);
+    }
+}
+
+/**
+ * Whether this node or an ancestor is already waiting on tile data (see QuadTreeNode::render).
+ */
+bool PlanetCube::isMapTilePending(QuadTreeNode* node) {
+    QuadTreeNode* ancestor = node;
+    while (ancestor && !ancestor->mMapTile && !ancestor->mPageOut) {
+        if (ancestor->mRequestMapTile || ancestor->mRequestRenderable) {
+            return true;
+        }
+        ancestor = ancestor->mParent;
+    }
+    return false;
+}
+    
 void PlanetCube::setCamera(Camera* camera) {
     mLODCamera = camera;
     if (camera) {
@@ -452,14 +845,17 @@ const Matrix3 PlanetCube::getFaceTransform(int face) {
     
     bool PlanetCube::CubeFrameListener::frameStarted(const FrameEvent& evt) {
         // Handle delayed requests (for rendering new tiles).
+        mCube->beginPagerFrame();
+        mCube->dropStaleRequests();
         mCube->handleRenderRequests();
         return true;
     }
     
 	bool PlanetCube::CubeFrameListener::frameRenderingQueued(const FrameEvent& evt) {
         if (!getBool("planet.treeFreeze")) {
-            // Prune the LOD tree
+            // Prune the LOD tree, then merge and page out tiles beyond the memory budget.
             mCube->pruneTree();
+            mCube->evictTiles();
 
             // Update LOD requests.
             mCube->handleInlineRequests();
@@ -468,11 +864,8 @@ const Matrix3 PlanetCube::getFaceTransform(int face) {
     }
     
     bool PlanetCube::CubeFrameListener::frameEnded(const FrameEvent& evt) {
+        mCube->endPagerFrame();
         return true;
     }
     
-
-    bool PlanetCube::RequestComparePriority::operator()(const Request& a, const Request& b) const {
-        return (a.mNode->getPriority() > b.mNode->getPriority());
-    }
 };
\ No newline at end of file
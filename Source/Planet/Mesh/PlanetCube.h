@@ -20,6 +20,8 @@ class PlanetCube;
 #include "Planet.h"
 #include "PlanetMap.h"
 #include "PlanetCubeTree.h"
+#include "PlanetRequestQueue.h"
+#include "PlanetTileResidency.h"
 
 using namespace Ogre;
 using namespace std;
@@ -45,22 +47,10 @@ class PlanetCube {
         REQUEST_MERGE,
     };
 
-    struct Request {
-        QuadTreeNode* mNode;
-        int mType;
-        
-        Request(QuadTreeNode* node, int type) : mNode(node), mType(type) {};
-    };
-
-    class RequestComparePriority {
-    public:
-        bool operator()(const Request& a, const Request& b) const;
-    }; 
-
 public:
     
     typedef set<PlanetCube*> PlanetCubeSet;
-    typedef list<Request> RequestQueue;
+    typedef PlanetRequestQueue RequestQueue;
     typedef set<QuadTreeNode*> NodeSet;
     typedef priority_queue<QuadTreeNode*, vector<QuadTreeNode*>, QuadTreeNodeCompareLastOpened> NodeHeap;
 
@@ -85,10 +75,22 @@ protected:
     void mergeQuadTreeNode(QuadTreeNode* node);
 
     void request(QuadTreeNode* node, int type, bool priority = false);
+    void prefetchRequest(QuadTreeNode* node, int type);
+    void confirmRequest(QuadTreeNode* node, int type);
+    void dropStaleRequests();
+    void waitFor(QuadTreeNode* node, int type, QuadTreeNode* on, int onType, bool prefetch = false);
+    void wake(QuadTreeNode* on, int onType);
+    void unlink(QuadTreeNode* node, int type);
+    void wakeFinishedTiles();
     void unrequest(QuadTreeNode* node);
-    void handleRequests(RequestQueue& queue);
+    void updatePriority(QuadTreeNode* node);
+    void reprioritize(QuadTreeNode* node);
+    void handleRequests(RequestQueue& queue, Real budget);
+    void beginPagerFrame();
+    void endPagerFrame();
     void handleRenderRequests();
     void handleInlineRequests();
+    void handleMapSteps(Real budget);
         
     bool handleRenderable(QuadTreeNode* node);
     bool handleMapTile(QuadTreeNode* node);
@@ -96,6 +98,11 @@ protected:
     bool handleMerge(QuadTreeNode* node);
 
     void pruneTree();
+    void evictTiles();
+    void updateSphereClip(PlanetLODConfiguration& lod);
+    void updatePrefetch(const Matrix4& viewMatrix, const Matrix4& fullTransform);
+    void prefetch(QuadTreeNode* node);
+    bool isMapTilePending(QuadTreeNode* node);
     void refreshMapTile(QuadTreeNode* node, PlanetMapTile* tile);
 
     class CubeFrameListener : public FrameListener {
@@ -114,6 +121,7 @@ protected:
     RequestQueue mRenderRequests;
     QuadTree* mFaces[6];
     NodeSet mOpenNodes;
+    PlanetTileResidency mResidency;
     
     MovableObject* mProxy;
     PlanetMap* mMap;
@@ -121,8 +129,23 @@ protected:
     Camera* mLODCamera;
     PlanetLODConfiguration mLOD;
 
+    // LOD camera extrapolated along its recent velocity, for prefetching.
+    bool mPrefetch;
+    PlanetLODConfiguration mPrefetchLOD;
+    Vector3 mLastCameraPosition;
+    Vector3 mCameraVelocity;
+    unsigned long mLastCameraTime;
+
     int mFrameCounter;
     Timer* mTimer;    
+
+    // Pager time accounting for the current frame, in microseconds.
+    Real mPagerBudget;
+    Real mPagerReserve;
+    Real mPagerTime;
+    Real mPagerDebt;
+    Real mPagerCost[4];
+    Real mPagerStepCost;
 };
 
 };
@@ -14,26 +14,31 @@
 namespace NFSpace {
 
 QuadTreeNode::QuadTreeNode(PlanetCube* cube) :
-mCube(cube),
-mRenderable(0),
-mMapTile(0),
-mParent(0),
-mParentSlot(-1),
 mFace(0),
+mLOD(0),
 mX(0),
 mY(0),
-mLOD(0),
+mRenderLevel(0),
+mHasChildren(false),
+mPageOut(false),
+mRequestPageOut(false),
 mRequestMapTile(false),
 mRequestRenderable(false),
 mRequestSplit(false),
 mRequestMerge(false),
-mPageOut(false),
-mHasChildren(false)
+mResident(false),
+mMapTile(0),
+mRenderable(0),
+mCube(cube),
+mParentSlot(-1),
+mParent(0)
 {
     mLastOpened = mLastRendered = mCube->getFrameCounter();
         
     for (int i = 0; i < 4; ++i) {
         mChildren[i] = 0;
+        mRequestSlot[i] = -1;
+        mBlockedOn[i] = 0;
     }
     PlanetStats::totalNodes++;
 }
@@ -84,11 +89,13 @@ void QuadTreeNode::createMapTile(PlanetMap* map) {
         throw "Creating map tile that already exists.";
     }
     mMapTile = map->finalizeTile(this);
+    updateResidency();
 }
 
 void QuadTreeNode::destroyMapTile() {
     if (mMapTile) delete mMapTile;
     mMapTile = 0;
+    updateResidency();
 }
     
 void QuadTreeNode::createRenderable(PlanetMapTile* map) {
@@ -101,12 +108,22 @@ void QuadTreeNode::createRenderable(PlanetMapTile* map) {
     }
     mRenderable = new PlanetRenderable(this, map);
     propagateLODDistances();
+    updateResidency();
 }
 
 void QuadTreeNode::destroyRenderable() {
     if (mRenderable) delete mRenderable;
     mRenderable = 0;
     propagateLODDistances();
+    updateResidency();
+}
+
+/**
+ * Account for our tile and renderable in the cube's residency, after either changed.
+ */
+void QuadTreeNode::updateResidency() {
+    size_t bytes = (mMapTile ? mMapTile->getGPUMemoryUsage() : 0) + (mRenderable ? mRenderable->getMemoryUsage() : 0);
+    mCube->mResidency.update(this, bytes, mCube->getFrameCounter());
 }
 
 void QuadTreeNode::attachChild(QuadTreeNode* child, int position) {
@@ -149,6 +166,10 @@ bool QuadTreeNode::willRender() {
             mRequestRenderable = true;
             mCube->request(this, PlanetCube::REQUEST_RENDERABLE);
         }
+        else if (mRequestMapTile) {
+            // Still waiting on a tile to build a renderable from.
+            mCube->confirmRequest(this, PlanetCube::REQUEST_MAPTILE);
+        }
         return false;
     }
     return true;
@@ -177,7 +198,7 @@ int QuadTreeNode::render(RenderQueue* queue, PlanetLODConfiguration& lod) {
             mRequestRenderable = true;
             mCube->request(this, PlanetCube::REQUEST_RENDERABLE);
         }
-        return level + 1;
+        return mRenderLevel = level + 1;
     }
     
     // If we are renderable, check LOD/visibility.
@@ -186,7 +207,7 @@ int QuadTreeNode::render(RenderQueue* queue, PlanetLODConfiguration& lod) {
         
         // If invisible, return immediately.
         if (mRenderable->isClipped()) {
-            return 1;
+            return mRenderLevel = 1;
         }
 
         // Whether to recurse down.
@@ -202,6 +223,10 @@ int QuadTreeNode::render(RenderQueue* queue, PlanetLODConfiguration& lod) {
                     recurse = true;
                 }
             }
+            // Still waiting for native res tile data.
+            else if (mRequestMapTile) {
+                mCube->confirmRequest(this, PlanetCube::REQUEST_MAPTILE);
+            }
             // Otherwise try to get native res tile data.
             else {
                 // Make sure no parents are waiting for tile data update.
@@ -242,14 +267,12 @@ int QuadTreeNode::render(RenderQueue* queue, PlanetLODConfiguration& lod) {
                     for (int i = 0; i < 4; ++i) {
                         level = min(level, mChildren[i]->render(queue, lod));
                     }
-                    // If we are a shallow node with a tile that is not being rendered or close to being rendered.
-                    if (level > 1 && mMapTile && mMapTile->getReferences() == 1) {
-                        PlanetStats::totalPagedOut++;
-                        mPageOut = true;
-                        destroyRenderable();
-                        destroyMapTile();
+                    // Our tile is about to be drawn again if the children merge, keep it fresh.
+                    // Deeper tiles age, and PlanetCube::evictTiles pages them out when over budget.
+                    if (level <= 1 && mMapTile) {
+                        mCube->mResidency.touch(this, mCube->getFrameCounter());
                     }
-                    return level + 1;
+                    return mRenderLevel = level + 1;
                 }
             }
             // If no children exist yet, request them.
@@ -276,9 +299,20 @@ int QuadTreeNode::render(RenderQueue* queue, PlanetLODConfiguration& lod) {
         mRenderable->updateRenderQueue(queue);
         PlanetStats::renderedRenderables++;
 
-        return 1;
+        // Mark us and the tile we're drawn with as used. It belongs to us or the nearest ancestor with a tile.
+        mCube->mResidency.touch(this, mCube->getFrameCounter());
+        const PlanetMapTile* tile = mRenderable->getMapTile();
+        QuadTreeNode* owner = this;
+        while (owner && owner->mMapTile != tile) {
+            owner = owner->mParent;
+        }
+        if (owner && owner != this) {
+            mCube->mResidency.touch(owner, mCube->getFrameCounter());
+        }
+
+        return mRenderLevel = 1;
     }
-    return 0;
+    return mRenderLevel = 0;
 }
     
 const Real QuadTreeNode::getPriority() const {
@@ -288,19 +322,6 @@ const Real QuadTreeNode::getPriority() const {
     }
     return mRenderable->getLODPriority();
 }
-
-unsigned long QuadTreeNode::getGPUMemoryUsage() {
-    unsigned long accum = 0;
-    if (mMapTile) {
-        accum += mMapTile->getGPUMemoryUsage();
-    }
-    for (int i = 0; i < 4; ++i) {
-        if (mChildren[i]) {
-            accum += mChildren[i]->getGPUMemoryUsage();
-        }
-    }
-    return accum;
-}
           
 bool QuadTreeNode::isSplit() {
     return mChildren[0] || mChildren[1] || mChildren[2] || mChildren[3];
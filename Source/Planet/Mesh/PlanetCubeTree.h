@@ -19,6 +19,7 @@ struct QuadTreeNode;
 
 #include "PlanetMap.h"
 #include "PlanetRenderable.h"
+#include "PlanetTileResidency.h"
 
 #include "Planet.h"
 #include "Utility.h"
@@ -28,6 +29,13 @@ namespace NFSpace {
 // Node inside a quad tree.
 struct QuadTreeNode {
     enum Slot { TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT };
+
+    // Request of another node that waits on one of this node's requests.
+    struct Dependent {
+        QuadTreeNode* mNode;
+        int mType;
+        int mOnType;
+    };
     
     QuadTreeNode(PlanetCube* cube);
     ~QuadTreeNode();
@@ -46,12 +54,11 @@ struct QuadTreeNode {
     
     void createRenderable(PlanetMapTile* map);
     void destroyRenderable();
+    void updateResidency();
     
     bool willRender();
     int render(RenderQueue* queue, PlanetLODConfiguration& lod);
 
-    unsigned long getGPUMemoryUsage();
-
     int mFace;
     int mLOD;
     int mX;
@@ -59,6 +66,8 @@ struct QuadTreeNode {
     
     int mLastRendered;
     int mLastOpened;
+    // Levels down to the nearest node that drew itself, as of the last render().
+    int mRenderLevel;
 
     bool mHasChildren;
 
@@ -69,6 +78,15 @@ struct QuadTreeNode {
     bool mRequestRenderable;
     bool mRequestSplit;
     bool mRequestMerge;
+
+    // Heap positions of queued requests, by PlanetCube request type (-1 = not queued).
+    int mRequestSlot[4];
+    // Task graph edges, see PlanetCube::waitFor. Node each request waits on, by type.
+    QuadTreeNode* mBlockedOn[4];
+    std::vector<Dependent> mDependents;
+    // Entry for our tile and renderable in the cube's PlanetTileResidency, while mResident.
+    bool mResident;
+    PlanetTileResidency::EntryList::iterator mResidentSlot;
     
     PlanetMapTile* mMapTile;
     PlanetRenderable* mRenderable;
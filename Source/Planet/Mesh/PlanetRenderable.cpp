@@ -236,8 +236,6 @@ void PlanetRenderable::analyseTerrain() {
     // Cache square.
     mDistanceSquared = mDistance * mDistance;
     
-    srand(2134);
-    
     //#define getPixel() ((((float)(((*(pMapRow)) & PlanetMapBuffer::LEVEL_MASK) >> PlanetMapBuffer::LEVEL_SHIFT)) - PlanetMapBuffer::LEVEL_MIN) / PlanetMapBuffer::LEVEL_RANGE)
 #define getPixel() ((Bitwise::halfToFloat(*((unsigned short*)(pMapRow))) - PlanetMapBuffer::LEVEL_MIN) / PlanetMapBuffer::LEVEL_RANGE)
     //#define getPixel() (((*((float*)(pMapRow))) - PlanetMapBuffer::LEVEL_MIN) / PlanetMapBuffer::LEVEL_RANGE)
@@ -543,6 +541,26 @@ void PlanetRenderable::setFrameOfReference(PlanetLODConfiguration& lod) {
     mIsInMIPRange = res * lod.mTexFactor * isolimit < distance;
 }
 
+/**
+ * Evaluate clipping and LOD/MIP range against another frame of reference (e.g. a
+ * predicted camera), leaving this renderable's current state untouched.
+ */
+void PlanetRenderable::testFrameOfReference(PlanetLODConfiguration& lod, bool& clipped, bool& inLODRange, bool& inMIPRange) {
+    bool isClipped = mIsClipped, isFarAway = mIsFarAway, isInLODRange = mIsInLODRange, isInMIPRange = mIsInMIPRange;
+    Real lodPriority = mLODPriority;
+
+    setFrameOfReference(lod);
+    clipped = mIsClipped;
+    inLODRange = mIsInLODRange;
+    inMIPRange = mIsInMIPRange;
+
+    mIsClipped = isClipped;
+    mIsFarAway = isFarAway;
+    mIsInLODRange = isInLODRange;
+    mIsInMIPRange = isInMIPRange;
+    mLODPriority = lodPriority;
+}
+
 const bool PlanetRenderable::isClipped() const {
     return mIsClipped;
 }
@@ -579,4 +597,14 @@ const PlanetMapTile* PlanetRenderable::getMapTile() {
     return mMapTile;
 }
 
+/**
+ * Memory held by this renderable alone. The grid geometry is shared by all instances, so
+ * that's its own state and shader parameters.
+ */
+size_t PlanetRenderable::getMemoryUsage() const {
+    return sizeof(PlanetRenderable) +
+           mCustomParameters.size() * (sizeof(CustomParameterMap::value_type) + 4 * sizeof(void*)) +
+           (mWireBoundingBox ? sizeof(WireBoundingBox) : 0);
+}
+
 };
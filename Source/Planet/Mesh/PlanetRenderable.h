@@ -40,8 +40,10 @@ public:
     Vector3& getCenter();
     Real getBoundingRadius();
     const PlanetMapTile* getMapTile();
+    size_t getMemoryUsage() const;
 
     void setFrameOfReference(PlanetLODConfiguration& lod);
+    void testFrameOfReference(PlanetLODConfiguration& lod, bool& clipped, bool& inLODRange, bool& inMIPRange);
     const bool isInLODRange() const;
     const bool isClipped() const;
     const bool isInMIPRange() const;
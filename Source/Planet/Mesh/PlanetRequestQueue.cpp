@@ -0,0 +1,245 @@
+/*
+ *  PlanetRequestQueue.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetRequestQueue.h"
+#include "PlanetCubeTree.h"
+
+namespace NFSpace {
+
+PlanetRequestQueue::PlanetRequestQueue() : mFront(0), mBack(0), mFrame(0) {
+}
+
+PlanetRequestQueue::~PlanetRequestQueue() {
+}
+
+bool PlanetRequestQueue::empty() const {
+    return mHeap.empty();
+}
+
+size_t PlanetRequestQueue::size() const {
+    return mHeap.size();
+}
+
+const PlanetRequestQueue::Request& PlanetRequestQueue::top() const {
+    return mHeap.front();
+}
+
+/**
+ * Queue a request, or update it if the node already has one of this type queued.
+ * Non-urgent requests queue behind others of the same priority.
+ */
+void PlanetRequestQueue::push(QuadTreeNode* node, int type, bool urgent) {
+    int index = node->mRequestSlot[type];
+    if (index >= 0) {
+        Request request = mHeap[index];
+        request.mDeferred = false;
+        request.mPrefetch = false;
+        request.mPriority = node->getPriority();
+        request.mWanted = mFrame;
+        if (urgent) {
+            request.mUrgent = true;
+            request.mSequence = --mFront;
+        }
+        place(index, request);
+        siftUp(index);
+        siftDown(node->mRequestSlot[type]);
+        return;
+    }
+
+    Request request;
+    request.mNode = node;
+    request.mType = type;
+    request.mBlocked = false;
+    request.mDeferred = false;
+    request.mPrefetch = false;
+    request.mUrgent = urgent;
+    request.mPriority = node->getPriority();
+    request.mSequence = urgent ? --mFront : mBack++;
+    request.mEnqueued = request.mWanted = mFrame;
+
+    mHeap.push_back(request);
+    place(mHeap.size() - 1, request);
+    siftUp(mHeap.size() - 1);
+}
+
+/**
+ * Queue a request behind all non-deferred ones, keeping its prefetch state.
+ */
+void PlanetRequestQueue::defer(QuadTreeNode* node, int type, bool prefetch) {
+    push(node, type, false);
+
+    int index = node->mRequestSlot[type];
+    mHeap[index].mDeferred = true;
+    mHeap[index].mPrefetch = prefetch;
+    siftDown(index);
+}
+
+/**
+ * Queue a low priority request, unless the node already has one of this type queued.
+ * Pushing the same request normally later promotes it.
+ */
+void PlanetRequestQueue::prefetch(QuadTreeNode* node, int type) {
+    if (node->mRequestSlot[type] >= 0) return;
+    push(node, type, false);
+
+    int index = node->mRequestSlot[type];
+    mHeap[index].mPrefetch = true;
+    siftDown(index);
+}
+
+/**
+ * Queue a request that can't make progress until unblocked, keeping its prefetch state.
+ */
+void PlanetRequestQueue::block(QuadTreeNode* node, int type, bool prefetch) {
+    push(node, type, false);
+
+    int index = node->mRequestSlot[type];
+    mHeap[index].mBlocked = true;
+    mHeap[index].mPrefetch = prefetch;
+    siftDown(index);
+}
+
+/**
+ * Make a blocked request runnable again, ahead of non-urgent ones.
+ */
+bool PlanetRequestQueue::unblock(QuadTreeNode* node, int type) {
+    int index = node->mRequestSlot[type];
+    if (index < 0 || !mHeap[index].mBlocked) return false;
+
+    Request request = mHeap[index];
+    request.mBlocked = false;
+    request.mUrgent = true;
+    request.mSequence = --mFront;
+    place(index, request);
+    siftUp(index);
+    return true;
+}
+
+void PlanetRequestQueue::pop() {
+    removeAt(0);
+}
+
+/**
+ * Cancel a node's request of the given type. Returns whether one was queued.
+ */
+bool PlanetRequestQueue::remove(QuadTreeNode* node, int type) {
+    int index = node->mRequestSlot[type];
+    if (index < 0) return false;
+    removeAt(index);
+    return true;
+}
+
+/**
+ * Mark a queued request as still wanted, without changing its place in the queue.
+ */
+bool PlanetRequestQueue::confirm(QuadTreeNode* node, int type) {
+    int index = node->mRequestSlot[type];
+    if (index < 0) return false;
+    mHeap[index].mWanted = mFrame;
+    return true;
+}
+
+/**
+ * List requests that haven't been wanted since before the given frame.
+ */
+void PlanetRequestQueue::getStale(int frame, std::vector<Request>& stale) const {
+    for (std::vector<Request>::const_iterator it = mHeap.begin(); it != mHeap.end(); ++it) {
+        if (it->mWanted < frame) {
+            stale.push_back(*it);
+        }
+    }
+}
+
+void PlanetRequestQueue::setFrame(int frame) {
+    mFrame = frame;
+}
+
+/**
+ * Refresh a queued request's cached node priority and drop its urgency, in O(log n).
+ */
+bool PlanetRequestQueue::update(QuadTreeNode* node, int type) {
+    int index = node->mRequestSlot[type];
+    if (index < 0) return false;
+
+    Request request = mHeap[index];
+    request.mPriority = node->getPriority();
+    request.mUrgent = false;
+    place(index, request);
+    siftUp(index);
+    siftDown(node->mRequestSlot[type]);
+    return true;
+}
+
+void PlanetRequestQueue::undefer() {
+    for (std::vector<Request>::iterator it = mHeap.begin(); it != mHeap.end(); ++it) {
+        it->mDeferred = false;
+    }
+    heapify();
+}
+
+bool PlanetRequestQueue::before(const Request& a, const Request& b) const {
+    if (a.mBlocked != b.mBlocked) return b.mBlocked;
+    if (a.mDeferred != b.mDeferred) return b.mDeferred;
+    if (a.mPrefetch != b.mPrefetch) return b.mPrefetch;
+    if (a.mUrgent != b.mUrgent) return a.mUrgent;
+    if (a.mPriority != b.mPriority) return a.mPriority > b.mPriority;
+    return a.mSequence < b.mSequence;
+}
+
+void PlanetRequestQueue::place(int index, const Request& request) {
+    mHeap[index] = request;
+    request.mNode->mRequestSlot[request.mType] = index;
+}
+
+void PlanetRequestQueue::siftUp(int index) {
+    Request request = mHeap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!before(request, mHeap[parent])) break;
+        place(index, mHeap[parent]);
+        index = parent;
+    }
+    place(index, request);
+}
+
+void PlanetRequestQueue::siftDown(int index) {
+    int count = mHeap.size();
+    Request request = mHeap[index];
+    for (;;) {
+        int child = index * 2 + 1;
+        if (child >= count) break;
+        if (child + 1 < count && before(mHeap[child + 1], mHeap[child])) ++child;
+        if (!before(mHeap[child], request)) break;
+        place(index, mHeap[child]);
+        index = child;
+    }
+    place(index, request);
+}
+
+void PlanetRequestQueue::removeAt(int index) {
+    mHeap[index].mNode->mRequestSlot[mHeap[index].mType] = -1;
+
+    // Fill the hole with the last request, and move that up or down.
+    Request moved = mHeap.back();
+    mHeap.pop_back();
+    if (index < (int)mHeap.size()) {
+        place(index, moved);
+        siftUp(index);
+        if (moved.mNode->mRequestSlot[moved.mType] == index) {
+            siftDown(index);
+        }
+    }
+}
+
+void PlanetRequestQueue::heapify() {
+    for (int index = (int)mHeap.size() / 2 - 1; index >= 0; --index) {
+        siftDown(index);
+    }
+}
+
+};
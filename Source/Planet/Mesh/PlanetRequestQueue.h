@@ -0,0 +1,91 @@
+/*
+ *  PlanetRequestQueue.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetRequestQueue_H
+#define PlanetRequestQueue_H
+
+#include <Ogre/Ogre.h>
+#include <vector>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+struct QuadTreeNode;
+
+/**
+ * Indexed binary heap of pager requests, highest priority first.
+ *
+ * Each node stores the heap position of its queued requests (QuadTreeNode::mRequestSlot,
+ * one per request type), so a request can be found, re-prioritised or cancelled in
+ * O(log n) without scanning. A node has at most one request of each type queued.
+ *
+ * Node priorities are cached, and refreshed when a request is pushed again or update()d.
+ * Urgent requests go ahead of all others until updated. Prefetch requests only run when no
+ * regular request is waiting. Deferred requests sort behind everything else until
+ * undefer(), so the pager can skip past them. Blocked requests wait behind those, until
+ * whatever they depend on calls unblock().
+ *
+ * Requests remember the frame they were queued and last wanted in. Pushing or confirming
+ * a request marks it as wanted in the current frame (see setFrame).
+ */
+class PlanetRequestQueue {
+public:
+    struct Request {
+        QuadTreeNode* mNode;
+        int mType;
+        bool mBlocked;
+        bool mDeferred;
+        bool mPrefetch;
+        bool mUrgent;
+        Real mPriority;
+        long mSequence;
+
+        int mEnqueued;
+        int mWanted;
+    };
+
+    PlanetRequestQueue();
+    ~PlanetRequestQueue();
+
+    bool empty() const;
+    size_t size() const;
+    const Request& top() const;
+
+    void push(QuadTreeNode* node, int type, bool urgent);
+    void defer(QuadTreeNode* node, int type, bool prefetch);
+    void prefetch(QuadTreeNode* node, int type);
+    void block(QuadTreeNode* node, int type, bool prefetch);
+    bool unblock(QuadTreeNode* node, int type);
+    void pop();
+    bool remove(QuadTreeNode* node, int type);
+
+    bool confirm(QuadTreeNode* node, int type);
+    void getStale(int frame, std::vector<Request>& stale) const;
+
+    void setFrame(int frame);
+    bool update(QuadTreeNode* node, int type);
+    void undefer();
+
+protected:
+    bool before(const Request& a, const Request& b) const;
+    void place(int index, const Request& request);
+    void siftUp(int index);
+    void siftDown(int index);
+    void removeAt(int index);
+    void heapify();
+
+    std::vector<Request> mHeap;
+    long mFront;
+    long mBack;
+    int mFrame;
+};
+
+};
+
+#endif
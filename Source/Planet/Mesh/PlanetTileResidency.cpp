@@ -0,0 +1,102 @@
+/*
+ *  PlanetTileResidency.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#include "PlanetTileResidency.h"
+#include "PlanetCubeTree.h"
+
+namespace NFSpace {
+
+PlanetTileResidency::PlanetTileResidency() : mUsage(0), mBudget(0) {
+}
+
+PlanetTileResidency::~PlanetTileResidency() {
+}
+
+/**
+ * Track a node's new tile or renderable, as the most recently used.
+ */
+void PlanetTileResidency::add(QuadTreeNode* node, size_t bytes, int frame) {
+    assert(!node->mResident);
+
+    Entry entry;
+    entry.mNode = node;
+    entry.mBytes = bytes;
+    entry.mUsed = frame;
+    node->mResidentSlot = mEntries.insert(mEntries.begin(), entry);
+    node->mResident = true;
+    mUsage += bytes;
+}
+
+/**
+ * Change a node's size, adding or removing its entry as needed (0 bytes = nothing held).
+ * A node that was already tracked keeps its place.
+ */
+void PlanetTileResidency::update(QuadTreeNode* node, size_t bytes, int frame) {
+    if (!bytes) {
+        remove(node);
+    }
+    else if (!node->mResident) {
+        add(node, bytes, frame);
+    }
+    else {
+        mUsage += bytes;
+        mUsage -= node->mResidentSlot->mBytes;
+        node->mResidentSlot->mBytes = bytes;
+    }
+}
+
+void PlanetTileResidency::remove(QuadTreeNode* node) {
+    if (!node->mResident) return;
+
+    mUsage -= node->mResidentSlot->mBytes;
+    mEntries.erase(node->mResidentSlot);
+    node->mResident = false;
+}
+
+/**
+ * Mark a node's entry as used in this frame.
+ */
+void PlanetTileResidency::touch(QuadTreeNode* node, int frame) {
+    if (!node->mResident) return;
+
+    node->mResidentSlot->mUsed = frame;
+    mEntries.splice(mEntries.begin(), mEntries, node->mResidentSlot);
+}
+
+size_t PlanetTileResidency::size() const {
+    return mEntries.size();
+}
+
+size_t PlanetTileResidency::getUsage() const {
+    return mUsage;
+}
+
+size_t PlanetTileResidency::getBudget() const {
+    return mBudget;
+}
+
+void PlanetTileResidency::setBudget(size_t budget) {
+    mBudget = budget;
+}
+
+bool PlanetTileResidency::isOverBudget() const {
+    return mUsage > mBudget;
+}
+
+/**
+ * Least recently used entry, walk towards end() for more recent ones.
+ */
+PlanetTileResidency::EntryList::const_reverse_iterator PlanetTileResidency::oldest() const {
+    return mEntries.rbegin();
+}
+
+PlanetTileResidency::EntryList::const_reverse_iterator PlanetTileResidency::end() const {
+    return mEntries.rend();
+}
+
+};
@@ -0,0 +1,66 @@
+/*
+ *  PlanetTileResidency.h
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+#ifndef PlanetTileResidency_H
+#define PlanetTileResidency_H
+
+#include <Ogre/Ogre.h>
+#include <list>
+
+using namespace Ogre;
+
+namespace NFSpace {
+
+struct QuadTreeNode;
+
+/**
+ * Byte-budgeted LRU of the map tiles and renderables held by a cube's quadtree.
+ *
+ * Every node with a PlanetMapTile or a PlanetRenderable has an entry counting both, most
+ * recently used first. A node is used when its renderable is drawn, and a tile when a
+ * renderable built from it is drawn. Each node stores its entry's position
+ * (QuadTreeNode::mResidentSlot), so updating, removing and touching an entry are O(1).
+ *
+ * The residency only does the bookkeeping. PlanetCube::evictTiles walks the entries
+ * from the least recently used end to pick what to merge or page out when over budget.
+ */
+class PlanetTileResidency {
+public:
+    struct Entry {
+        QuadTreeNode* mNode;
+        size_t mBytes;
+        int mUsed;
+    };
+    typedef std::list<Entry> EntryList;
+
+    PlanetTileResidency();
+    ~PlanetTileResidency();
+
+    void add(QuadTreeNode* node, size_t bytes, int frame);
+    void update(QuadTreeNode* node, size_t bytes, int frame);
+    void remove(QuadTreeNode* node);
+    void touch(QuadTreeNode* node, int frame);
+
+    size_t size() const;
+    size_t getUsage() const;
+    size_t getBudget() const;
+    void setBudget(size_t budget);
+    bool isOverBudget() const;
+
+    EntryList::const_reverse_iterator oldest() const;
+    EntryList::const_reverse_iterator end() const;
+
+protected:
+    EntryList mEntries;
+    size_t mUsage;
+    size_t mBudget;
+};
+
+};
+
+#endif
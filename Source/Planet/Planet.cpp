@@ -22,5 +22,11 @@ namespace NFSpace {
     int PlanetStats::renderedRenderables = 0;
     int PlanetStats::hotTiles = 0;
     int PlanetStats::gpuMemoryUsage = 0;
+    int PlanetStats::cpuMemoryUsage = 0;
+    int PlanetStats::retainedTiles = 0;
+    int PlanetStats::retainedMemoryUsage = 0;
+    int PlanetStats::pagerTime = 0;
+    int PlanetStats::pagerOverruns = 0;
+    int PlanetStats::droppedTiles = 0;
 
 };
\ No newline at end of file
@@ -19,6 +19,7 @@ namespace NFSpace {
     class PlanetFilter;
     class PlanetMap;
     class PlanetMapBuffer;
+    class PlanetMapRasterizer;
     class PlanetMapTile;
     class PlanetCube;
     class QuadTree;
@@ -41,6 +42,12 @@ namespace Planet {
         static int hotTiles;
         static int renderedRenderables;
         static int gpuMemoryUsage;
+        static int cpuMemoryUsage;
+        static int retainedTiles;
+        static int retainedMemoryUsage;
+        static int pagerTime;
+        static int pagerOverruns;
+        static int droppedTiles;
     };
     
     struct PlanetLODConfiguration {
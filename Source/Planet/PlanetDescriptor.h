@@ -28,6 +28,9 @@ namespace NFSpace {
             int lodLimit;
             Real radius;
             Real height;
+
+            int baseMapSize;
+            Real baseMapThreshold;
     };
 
 }
@@ -109,11 +109,14 @@ String PlanetMovableFactory::FACTORY_TYPE_NAME = "PlanetMovable";
 PlanetDescriptor PlanetMovableFactory::getDefaultDescriptor() {
     PlanetDescriptor descriptor;
 
+    descriptor.script = getString("planet.script");
     descriptor.seed = getInt("planet.seed");
     descriptor.brushes = getInt("planet.brushes");
     descriptor.radius = getReal("planet.radius");
     descriptor.height = getReal("planet.height");
     descriptor.lodLimit = getInt("planet.lodLimit");
+    descriptor.baseMapSize = getInt("planet.baseMapSize");
+    descriptor.baseMapThreshold = getReal("planet.baseMapThreshold");
 
     return descriptor;
 }
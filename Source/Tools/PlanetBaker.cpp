@@ -0,0 +1,310 @@
+/*
+ *  PlanetBaker.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+/**
+ * Offline tile baker: generates every map tile of a planet up to a given LOD with the CPU
+ * map backend, and writes them to a PlanetTilePack.
+ *
+ * Runs headless: it only creates an Ogre Root to load the brush maps, without plugins,
+ * render system or window. The pack is written where a tile cache with the same settings
+ * looks for it, so the game picks it up with
+ *
+ *     planet.mapBackend = CPU, planet.tileCache = <cache>
+ *
+ * Usage:
+ *
+ *     PlanetBaker [options] <cache directory>
+ *
+ *     -seed N, -brushes N, -radius R, -height H   planet descriptor (defaults as in EngineState)
+ *     -script FILE                                terrain script (see PlanetTerrainScript)
+ *     -baseMapSize N, -baseMapThreshold R         base map pyramid (see PlanetBaseMap)
+ *     -textureSize N                              tile size, must match the game's
+ *     -lod N                                      deepest LOD to bake (default 4)
+ *     -threads N                                  worker threads (default 0 = one per core)
+ *     -media DIR                                  brush maps (default Resources/Media/Planet/Maps)
+ *
+ * Build: link the Core/EngineState, Core/Utility and Planet sources with Ogre (no OIS).
+ */
+
+#include <Ogre/Ogre.h>
+
+#include "EngineState.h"
+#include "Utility.h"
+#include "PlanetMovable.h"
+#include "PlanetBaseMap.h"
+#include "PlanetBrushIndex.h"
+#include "PlanetBrushTable.h"
+#include "PlanetMapGenerator.h"
+#include "PlanetMapWorkers.h"
+#include "PlanetTerrainScript.h"
+#include "PlanetTileCache.h"
+#include "PlanetTilePack.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Ogre;
+using namespace NFSpace;
+
+namespace {
+
+    /**
+     * Builds one tile, like PlanetMap::TileJob without the node.
+     */
+    class BakeJob : public PlanetMapWorkers::Job {
+    public:
+        BakeJob(const PlanetMapGenerator* generator, const PlanetBrushTable* table, const PlanetBrushIndex* index,
+                bool brushes, int face, int lod, int x, int y)
+        : mGenerator(generator), mTable(table), mIndex(index), mBrushes(brushes),
+          mFace(face), mLOD(lod), mX(x), mY(y) {
+            mWorkspace = OGRE_ALLOC_T(float, mGenerator->getWorkspaceSize(), MEMCATEGORY_GENERAL);
+        }
+
+        virtual ~BakeJob() {
+            OGRE_FREE(mWorkspace, MEMCATEGORY_GENERAL);
+            if (mHeightImage.getData()) {
+                OGRE_FREE(mHeightImage.getData(), MEMCATEGORY_GENERAL);
+            }
+            if (mNormalImage.getData()) {
+                OGRE_FREE(mNormalImage.getData(), MEMCATEGORY_GENERAL);
+            }
+        }
+
+        virtual void run() {
+            PlanetBrushTable::BrushSet brushes;
+            if (mBrushes) {
+                mIndex->query(mFace, mLOD, mX, mY, brushes);
+            }
+            mGenerator->generate(mFace, mLOD, mX, mY, *mTable, brushes, mWorkspace, mHeightImage, mNormalImage, 0, 0);
+        }
+
+        const PlanetMapGenerator* mGenerator;
+        const PlanetBrushTable* mTable;
+        const PlanetBrushIndex* mIndex;
+        bool mBrushes;
+
+        int mFace;
+        int mLOD;
+        int mX;
+        int mY;
+
+        float* mWorkspace;
+        Image mHeightImage;
+        Image mNormalImage;
+    };
+
+    struct Option {
+        const char* mName;
+        const char* mKey;
+    };
+
+    // Command line options that set engine settings.
+    const Option OPTIONS[] = {
+        { "-seed", "planet.seed" },
+        { "-brushes", "planet.brushes" },
+        { "-radius", "planet.radius" },
+        { "-height", "planet.height" },
+        { "-baseMapSize", "planet.baseMapSize" },
+        { "-baseMapThreshold", "planet.baseMapThreshold" },
+        { "-textureSize", "planet.textureSize" },
+        { 0, 0 }
+    };
+
+    int usage() {
+        std::cerr << "Usage: PlanetBaker [-seed N] [-brushes N] [-radius R] [-height H] [-script FILE]" << std::endl
+                  << "                   [-baseMapSize N] [-baseMapThreshold R] [-textureSize N]" << std::endl
+                  << "                   [-lod N] [-threads N] [-media DIR] <cache directory>" << std::endl;
+        return 1;
+    }
+
+    bool readFile(const String& path, String& contents) {
+        std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+        if (!stream) return false;
+        std::ostringstream buffer;
+        buffer << stream.rdbuf();
+        contents = buffer.str();
+        return true;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    // Settings start out at the game's defaults.
+    EngineState* state = new EngineState();
+
+    int maxLOD = 4;
+    int threads = 0;
+    String media = "Resources/Media/Planet/Maps";
+    String cache;
+
+    for (int i = 1; i < argc; ++i) {
+        String arg = argv[i];
+        if (arg[0] != '-') {
+            cache = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return usage();
+        String value = argv[++i];
+
+        bool found = false;
+        for (const Option* option = OPTIONS; option->mName; ++option) {
+            if (arg == option->mName) {
+                state->setValue(option->mKey, EngineState::VariableValue(value));
+                found = true;
+            }
+        }
+        if (found) continue;
+
+        if (arg == "-script") {
+            String script;
+            if (!readFile(value, script)) {
+                std::cerr << "Can't read script " << value << std::endl;
+                return 1;
+            }
+            state->setValue("planet.script", EngineState::VariableValue(script));
+        }
+        else if (arg == "-lod") {
+            maxLOD = StringConverter::parseInt(value);
+        }
+        else if (arg == "-threads") {
+            threads = StringConverter::parseInt(value);
+        }
+        else if (arg == "-media") {
+            media = value;
+        }
+        else {
+            return usage();
+        }
+    }
+    if (cache.empty()) return usage();
+
+    // No plugins, config or render system: only used for image codecs and resource lookup.
+    Root* root = new Root("", "", "PlanetBaker.log");
+    ResourceGroupManager::getSingleton().addResourceLocation(media, "FileSystem");
+
+    PlanetDescriptor descriptor = PlanetMovableFactory::getDefaultDescriptor();
+    int textureSize = getInt("planet.textureSize");
+    if (threads <= 0) {
+        threads = getProcessorCount();
+    }
+
+    int status = 0;
+    try {
+        PlanetMapWorkers workers(threads);
+
+        // Same setup as PlanetMap::prepareHeightMap on the CPU backend.
+        PlanetBrushTable table;
+        table.generate(descriptor.seed, descriptor.brushes);
+
+        PlanetMapGenerator generator(textureSize, 1, 0.5f);
+        PlanetTerrainScript* script = 0;
+        if (!descriptor.script.empty()) {
+            script = new PlanetTerrainScript(descriptor.script, descriptor.seed);
+            generator.setScript(script);
+        }
+
+        PlanetBaseMap* baseMap = 0;
+        PlanetBrushIndex* index;
+        if (descriptor.baseMapSize > 0) {
+            PlanetBrushTable::BrushSet baked, live;
+            PlanetBaseMap::splitBrushes(table, descriptor.baseMapThreshold, baked, live);
+            baseMap = new PlanetBaseMap(table, baked, descriptor.baseMapSize, &workers);
+            generator.setBaseMap(baseMap);
+            index = new PlanetBrushIndex(table, live, textureSize, 1);
+        }
+        else {
+            index = new PlanetBrushIndex(table, textureSize, 1);
+        }
+        bool brushes = !script || script->usesBrushes();
+
+        // Tiles go where a CPU backend tile cache for this planet looks for its pack.
+        String settings = PlanetTileCache::getSettings("CPU", textureSize, false);
+        String path = PlanetTileCache::getPackPath(cache, descriptor, settings);
+        mkdir(cache.c_str(), 0755);
+
+        PlanetTilePack::Writer writer;
+        if (!writer.open(path)) {
+            OGRE_EXCEPT(Exception::ERR_CANNOT_WRITE_TO_FILE, "Can't write " + path, "PlanetBaker");
+        }
+
+        int total = 0;
+        for (int lod = 0; lod <= maxLOD; ++lod) {
+            total += 6 << (2 * lod);
+        }
+        std::cout << "Baking " << total << " tiles (LOD 0-" << maxLOD << ", " << textureSize << "px) on "
+                  << threads << " threads to " << path << std::endl;
+
+        Timer timer;
+        int submitted = 0, written = 0;
+        int face = 0, lod = 0, x = 0, y = 0;
+        while (written < total) {
+            // Keep the pool busy, without holding more than a few finished tiles in memory.
+            while (submitted < total && submitted - written < threads * 2) {
+                workers.submit(new BakeJob(&generator, &table, index, brushes, face, lod, x, y));
+                submitted++;
+
+                // Next tile: row by row, then face by face, then LOD by LOD.
+                if (++x == (1 << lod)) {
+                    x = 0;
+                    if (++y == (1 << lod)) {
+                        y = 0;
+                        if (++face == 6) {
+                            face = 0;
+                            lod++;
+                        }
+                    }
+                }
+            }
+
+            PlanetMapWorkers::JobList finished;
+            workers.collect(finished);
+            if (finished.empty()) {
+                usleep(1000);
+                continue;
+            }
+            for (PlanetMapWorkers::JobList::iterator it = finished.begin(); it != finished.end(); ++it) {
+                BakeJob* job = static_cast<BakeJob*>(*it);
+                if (!writer.add(job->mFace, job->mLOD, job->mX, job->mY, job->mHeightImage, job->mNormalImage)) {
+                    OGRE_EXCEPT(Exception::ERR_CANNOT_WRITE_TO_FILE, "Can't write " + path, "PlanetBaker");
+                }
+                delete job;
+                written++;
+            }
+            if (written % 256 < (int)finished.size() || written == total) {
+                std::cout << "\r" << written << "/" << total << std::flush;
+            }
+        }
+        std::cout << std::endl;
+
+        if (!writer.close()) {
+            OGRE_EXCEPT(Exception::ERR_CANNOT_WRITE_TO_FILE, "Can't write " + path, "PlanetBaker");
+        }
+
+        Real seconds = maxf(timer.getMilliseconds() / 1000.0f, 0.001f);
+        std::cout << written << " tiles in " << seconds << "s (" << (written / seconds) << " tiles/s), "
+                  << writer.getSize() << " bytes written ("
+                  << (writer.getSize() / seconds / (1024 * 1024)) << " MB/s)" << std::endl;
+
+        delete index;
+        generator.setBaseMap(0);
+        generator.setScript(0);
+        delete baseMap;
+        delete script;
+    }
+    catch (Exception& e) {
+        std::cerr << e.getFullDescription() << std::endl;
+        status = 1;
+    }
+
+    delete root;
+    delete state;
+    return status;
+}
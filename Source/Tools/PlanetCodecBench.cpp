@@ -0,0 +1,165 @@
+/*
+ *  PlanetCodecBench.cpp
+ *  NFSpace
+ *
+ *  Copyright 2010 __MyCompanyName__. All rights reserved.
+ *
+ */
+
+/**
+ * Throughput and ratio benchmark for PlanetHalfCodec, on real tiles.
+ *
+ * Reads every tile of a PlanetTilePack (see PlanetBaker), then encodes and decodes all the
+ * height and normal images a number of times, checking each round trip is exact.
+ *
+ * Usage:
+ *
+ *     PlanetCodecBench [-rounds N] [-tiles N] <pack file>
+ *
+ * Build: link Core/Utility, Planet/Map/PlanetHalfCodec and Planet/Map/PlanetTilePack with Ogre.
+ */
+
+#include <Ogre/Ogre.h>
+
+#include "PlanetHalfCodec.h"
+#include "PlanetTilePack.h"
+
+#include <iostream>
+
+using namespace Ogre;
+using namespace NFSpace;
+
+namespace {
+
+    inline Real maxf(Real a, Real b) {
+        return a > b ? a : b;
+    }
+
+    struct Result {
+        size_t mImages;
+        uint64 mRawBytes;
+        uint64 mCodedBytes;
+        unsigned long mEncodeTime;
+        unsigned long mDecodeTime;
+        bool mExact;
+    };
+
+    /**
+     * Encode and decode the images rounds times, timing each half.
+     */
+    Result run(const std::vector<Image>& images, int rounds) {
+        Result result;
+        result.mImages = images.size();
+        result.mRawBytes = 0;
+        result.mCodedBytes = 0;
+        result.mEncodeTime = 0;
+        result.mDecodeTime = 0;
+        result.mExact = true;
+
+        std::vector<std::vector<uchar> > coded(images.size());
+        Timer timer;
+        for (int round = 0; round < rounds; ++round) {
+            timer.reset();
+            for (size_t i = 0; i < images.size(); ++i) {
+                coded[i].clear();
+                PlanetHalfCodec::encode(images[i], coded[i]);
+            }
+            result.mEncodeTime += timer.getMicroseconds();
+
+            std::vector<Image> decoded(images.size());
+            timer.reset();
+            for (size_t i = 0; i < images.size(); ++i) {
+                if (!PlanetHalfCodec::decode(&coded[i][0], coded[i].size(), decoded[i])) {
+                    result.mExact = false;
+                }
+            }
+            result.mDecodeTime += timer.getMicroseconds();
+
+            for (size_t i = 0; i < images.size(); ++i) {
+                if (!decoded[i].getData()) continue;
+                if (decoded[i].getSize() != images[i].getSize() ||
+                    memcmp(decoded[i].getData(), images[i].getData(), images[i].getSize()) != 0) {
+                    result.mExact = false;
+                }
+                OGRE_FREE(decoded[i].getData(), MEMCATEGORY_GENERAL);
+            }
+        }
+
+        for (size_t i = 0; i < images.size(); ++i) {
+            result.mRawBytes += images[i].getSize();
+            result.mCodedBytes += coded[i].size();
+        }
+        return result;
+    }
+
+    void report(const String& name, const Result& result, int rounds) {
+        Real megabytes = (Real)result.mRawBytes * rounds / (1024 * 1024);
+        Real encodeSeconds = maxf(result.mEncodeTime / 1e6f, 1e-6f);
+        Real decodeSeconds = maxf(result.mDecodeTime / 1e6f, 1e-6f);
+
+        std::cout << name << ": " << result.mImages << " images, "
+                  << result.mRawBytes << " -> " << result.mCodedBytes << " bytes ("
+                  << ((Real)result.mRawBytes / maxf(result.mCodedBytes, 1)) << ":1, "
+                  << (result.mCodedBytes * 16.0f / maxf(result.mRawBytes, 1)) << " bits/sample), "
+                  << "encode " << (megabytes / encodeSeconds) << " MB/s, "
+                  << "decode " << (megabytes / decodeSeconds) << " MB/s"
+                  << (result.mExact ? "" : ", ROUND TRIP FAILED") << std::endl;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int rounds = 5;
+    size_t limit = 0;
+    String path;
+
+    for (int i = 1; i < argc; ++i) {
+        String arg = argv[i];
+        if (arg == "-rounds" && i + 1 < argc) {
+            rounds = StringConverter::parseInt(argv[++i]);
+        }
+        else if (arg == "-tiles" && i + 1 < argc) {
+            limit = StringConverter::parseInt(argv[++i]);
+        }
+        else if (arg[0] != '-') {
+            path = arg;
+        }
+        else {
+            path = "";
+            break;
+        }
+    }
+    if (path.empty() || rounds < 1) {
+        std::cerr << "Usage: PlanetCodecBench [-rounds N] [-tiles N] <pack file>" << std::endl;
+        return 1;
+    }
+
+    PlanetTilePack pack;
+    if (!pack.open(path)) {
+        std::cerr << "Can't open tile pack " << path << std::endl;
+        return 1;
+    }
+
+    // Pack images are read-only mappings, which is all encode() needs.
+    std::vector<Image> heights, normals;
+    size_t count = limit ? std::min(limit, pack.getTileCount()) : pack.getTileCount();
+    for (size_t i = 0; i < count; ++i) {
+        int face, lod, x, y;
+        Image heightImage, normalImage;
+        pack.getTile(i, face, lod, x, y, heightImage, normalImage);
+        if (PlanetHalfCodec::canEncode(heightImage)) heights.push_back(heightImage);
+        if (PlanetHalfCodec::canEncode(normalImage)) normals.push_back(normalImage);
+    }
+    if (heights.empty() && normals.empty()) {
+        std::cerr << "No half float tiles in " << path << std::endl;
+        return 1;
+    }
+
+    std::cout << "PlanetHalfCodec, " << count << " tiles, " << rounds << " rounds" << std::endl;
+    Result height = run(heights, rounds);
+    Result normal = run(normals, rounds);
+    report("Heights", height, rounds);
+    report("Normals", normal, rounds);
+
+    return height.mExact && normal.mExact ? 0 : 1;
+}